@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include <aig.hpp>
+
+namespace fresub {
+
+  // Immutable CSR view of an AIG for parallel read-only stages. Unlike
+  // aigman::vvFanouts, it is never filled lazily, so any number of threads
+  // may read it while nobody touches the aigman.
+  struct AigSnapshot {
+    int num_pis = 0;
+    int num_objs = 0;
+    std::vector<int> fanins;          // 2 literals per node (-1 for constant, PIs and dead nodes)
+    std::vector<int> fanout_offsets;  // CSR offsets into fanout_indices (size num_objs + 1)
+    std::vector<int> fanout_indices;  // gate fanouts of each node, ascending
+    std::vector<int> refs;            // references: gate fanouts plus POs
+    std::vector<int> levels;          // logic level (empty unless the AIG is sorted)
+    std::vector<int> pos;             // PO literals
+
+    bool is_gate(int node) const { return fanins[node * 2] >= 0; }
+    const int* fanouts_begin(int node) const { return fanout_indices.data() + fanout_offsets[node]; }
+    const int* fanouts_end(int node) const { return fanout_indices.data() + fanout_offsets[node + 1]; }
+  };
+
+  // Build the snapshot on num_threads threads; the result does not depend on
+  // the thread count
+  void build_aig_snapshot(const aigman& aig, int num_threads, AigSnapshot& snapshot);
+
+} // namespace fresub
@@ -16,6 +16,9 @@ inline int var2lit(int var, bool comp = false) { return (var << 1) | (comp ? 1 :
 // Node accessibility helper (alive and in range)
 bool is_node_accessible(const aigman& aig, int node);
 
+// Logic level of every node (PIs and constant at 0). Requires a sorted AIG.
+std::vector<int> compute_levels(const aigman& aig);
+
 // Compute the MFFC (maximum fanout-free cone) using a dereference counter array.
 // - Assumes `deref` entries are all 0 on entry; the function will restore all
 //   touched entries back to 0 before returning.
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace fresub {
+
+  // Allocation counting for builds with the FRESUB_ALLOC_STATS CMake option:
+  // alloc_stats.cpp then replaces the global operator new/delete with
+  // versions that count allocations, requested bytes and live bytes
+  // (process-wide, so concurrent stages share the peak).
+
+  struct AllocStageStats {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;            // requested
+    uint64_t peak_live_bytes = 0;  // maximum of live heap bytes during the stage
+
+    void add(const AllocStageStats& o) {
+      allocations += o.allocations;
+      bytes += o.bytes;
+      peak_live_bytes = std::max(peak_live_bytes, o.peak_live_bytes);
+    }
+  };
+
+#ifdef FRESUB_ALLOC_STATS
+  struct AllocCounters {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t live_bytes = 0;
+    uint64_t peak_live_bytes = 0;
+  };
+
+  AllocCounters alloc_counters();
+
+  // Restart peak tracking from the current live bytes
+  void alloc_reset_peak();
+
+  // Adds the allocations made from construction until stop() (or
+  // destruction) to a stage
+  class AllocScope {
+  public:
+    explicit AllocScope(AllocStageStats& stage) : stage(&stage) {
+      alloc_reset_peak();
+      start = alloc_counters();
+    }
+    ~AllocScope() { stop(); }
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+    void stop() {
+      if (!stage) return;
+      AllocCounters end = alloc_counters();
+      AllocStageStats delta;
+      delta.allocations = end.allocations - start.allocations;
+      delta.bytes = end.bytes - start.bytes;
+      delta.peak_live_bytes = end.peak_live_bytes;
+      stage->add(delta);
+      stage = nullptr;
+    }
+
+  private:
+    AllocStageStats* stage;
+    AllocCounters start;
+  };
+#else
+  class AllocScope {
+  public:
+    explicit AllocScope(AllocStageStats&) {}
+    void stop() {}
+  };
+#endif
+
+} // namespace fresub
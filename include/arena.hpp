@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace fresub {
+
+  // Bump allocator over large mappings backed by huge pages where possible:
+  // MAP_HUGETLB first, otherwise a 2 MB-aligned anonymous mapping advised
+  // with MADV_HUGEPAGE. Memory is only returned all at once by reset().
+  // Thread-safe.
+  class HugePageArena {
+  public:
+    static constexpr size_t HUGE_PAGE = size_t(2) << 20;
+
+    struct Stats {
+      size_t bytes = 0;        // allocated since the last reset
+      size_t peak_bytes = 0;   // maximum of bytes over the arena's lifetime
+      size_t huge_pages = 0;   // mapped with MAP_HUGETLB, over the lifetime
+      size_t thp_pages = 0;    // 2 MB pages mapped with MADV_HUGEPAGE, over the lifetime
+    };
+
+    explicit HugePageArena(size_t block_bytes = 4 * HUGE_PAGE) : block_bytes(block_bytes) {}
+    HugePageArena(const HugePageArena&) = delete;
+    HugePageArena& operator=(const HugePageArena&) = delete;
+    ~HugePageArena() { reset(); }
+
+    // Returns nullptr if no mapping can be created
+    void* allocate(size_t bytes, size_t align = 64);
+
+    // Unmap every block; all allocations become invalid
+    void reset();
+
+    Stats stats();
+
+  private:
+    struct Block {
+      char* base;
+      size_t size;
+    };
+    bool map_block(size_t min_bytes);
+
+    std::mutex mutex;
+    size_t block_bytes;
+    std::vector<Block> blocks;
+    size_t used = 0;  // in the last block
+    Stats counters;
+  };
+
+} // namespace fresub
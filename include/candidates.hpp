@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "window.hpp"
+
+namespace fresub {
+
+  // Sharded candidate generation: processes that share the input AIG each
+  // handle the windows of one shard and write their synthesized feasible sets
+  // to a candidate file; a final process loads all files and runs insertion.
+
+  // True if the window with this cut ID belongs to shard `shard` of `num_shards`
+  bool in_shard(int cut_id, int shard, int num_shards);
+
+  // Fingerprint of the AIG structure and the window enumeration settings
+  // (salt). Candidate files only merge into runs with the same fingerprint.
+  uint64_t candidate_fingerprint(const aigman& aig, uint64_t salt);
+
+  // Write every feasible set with a synthesized circuit, together with the
+  // window's care mask and ODC flags. Returns false (with a message on
+  // stderr) on I/O errors.
+  bool write_candidates(const std::string& path, uint64_t fingerprint, const std::vector<Window>& windows);
+
+  // Attach the candidates of a file to windows (matched by cut_id); restores
+  // care and ODC flags. Returns the number of candidates read, or -1 (with a
+  // message on stderr) if the file is unreadable or from another run.
+  int read_candidates(const std::string& path, uint64_t fingerprint, std::vector<Window>& windows);
+
+  // The records of a candidate file without its header, for other storage
+  // (--spill). Decoding attaches candidates like read_candidates and returns
+  // their number, or -1 if the data is truncated or corrupt.
+  void encode_candidate_records(std::vector<Window>::const_iterator begin, std::vector<Window>::const_iterator end,
+                                std::vector<unsigned char>& out);
+  int decode_candidate_records(const unsigned char* data, size_t size, std::vector<Window>& windows);
+
+  // Consolidation before synthesis: all windows of a target compete for the
+  // same replacement, so keep only its max_per_target most promising feasible
+  // sets (list and bitmap entries). Sets are ranked by optimistic gain,
+  // mffc_size minus the k - 1 gates needed to combine k divisors (exact for
+  // sets already synthesized); ties keep window order. Dropped synthesized
+  // circuits are deleted. Returns the number of sets dropped.
+  size_t consolidate_candidates(std::vector<Window>& windows, int max_per_target);
+
+} // namespace fresub
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+namespace fresub {
+namespace cuda {
+
+  // Flat view of M feasibility problems, shared by the host code that builds
+  // it from windows (cuda_feasibility.cpp) and the kernels. Problem p has
+  // num_inputs[p] inputs and its truth tables (divisors, then the target),
+  // (2^num_inputs[p] + 63) / 64 words each, at
+  // flat_problems[problem_offsets[p] .. problem_offsets[p + 1]);
+  // problem_offsets[M] = total_elements.
+
+  // solutions[p]: divisor bit mask of the first feasible 4-set, 0 if none
+  void solve_resub_problems_cuda(uint64_t* flat_problems, uint32_t* solutions,
+                                 int* problem_offsets, int* num_inputs, int M, int total_elements);
+
+  // feasibility_results[combination_offsets[p] + ((i * D + j) * D + k) * D + l]
+  // is 1 if divisors i < j < k < l of problem p (D divisors) are feasible
+  void solve_resub_problems_cuda_all(uint64_t* flat_problems, char* feasibility_results,
+                                     int* problem_offsets, int* combination_offsets,
+                                     int* num_inputs, int M, int total_elements, int total_combinations);
+
+} // namespace cuda
+} // namespace fresub
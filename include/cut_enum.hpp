@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <aig.hpp>
+#include "aig_snapshot.hpp"
+
+namespace fresub {
+
+  // Cut with inline, sorted leaves. signature has bit (leaf % 64) set for
+  // every leaf, so subset and size bounds can be rejected without touching
+  // the leaves.
+  struct InlineCut {
+    static constexpr int MAX_LEAVES = 8;
+    int leaves[MAX_LEAVES];
+    uint64_t signature = 0;
+    uint8_t size = 0;
+
+    const int* begin() const { return leaves; }
+    const int* end() const { return leaves + size; }
+  };
+
+  // Cuts of all nodes in one flat array. The cuts of node n are
+  // cuts[first[n] .. first[n] + count[n]), starting with the trivial cut {n}
+  // (except for the constant node, whose only cut is empty).
+  struct CutSet {
+    std::vector<InlineCut> cuts;
+    std::vector<uint32_t> first;
+    std::vector<uint32_t> count;
+
+    const InlineCut* node_begin(int node) const { return cuts.data() + first[node]; }
+    const InlineCut* node_end(int node) const { return cuts.data() + first[node] + count[node]; }
+  };
+
+  // Enumerate dominance-free cuts of up to max_cut_size (<= InlineCut::MAX_LEAVES)
+  // leaves. Each node keeps at most max_cuts_per_node non-trivial cuts, the
+  // smallest first. Nodes of one level are processed by num_threads threads;
+  // the result does not depend on the thread count. Requires a sorted AIG.
+  void enumerate_cuts(const AigSnapshot& aig, int max_cut_size, int max_cuts_per_node, int num_threads, CutSet& out);
+  void enumerate_cuts(const aigman& aig, int max_cut_size, int max_cuts_per_node, int num_threads, CutSet& out);
+
+} // namespace fresub
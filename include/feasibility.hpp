@@ -1,28 +1,62 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <unordered_map>
 #include <vector>
 
 #include "window.hpp"
 
 namespace fresub {
+  // The kernels below take an optional care mask (one word per truth-table
+  // word); only target onset/offset patterns under the mask must be separated.
+
   // Exposed for tests: CPU overlap-based feasibility for 4-divisor case
-  bool solve_resub_overlap_multiword(int i, int j, int k, int l, const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs);
+  bool solve_resub_overlap_multiword(int i, int j, int k, int l, const TruthTables& truth_tables, int num_inputs, const uint64_t* care = nullptr);
   // Exposed for tests: CPU overlap-based feasibility for 0..3 divisors
-  bool solve_resub_overlap_multiword_0(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs);
+  bool solve_resub_overlap_multiword_0(const TruthTables& truth_tables, int num_inputs, const uint64_t* care = nullptr);
   // Exposed for tests: CPU overlap-based feasibility for 1..3 divisors
-  bool solve_resub_overlap_multiword_1(int i, const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs);
-  bool solve_resub_overlap_multiword_2(int i, int j, const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs);
-  bool solve_resub_overlap_multiword_3(int i, int j, int k, const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs);
+  bool solve_resub_overlap_multiword_1(int i, const TruthTables& truth_tables, int num_inputs, const uint64_t* care = nullptr);
+  bool solve_resub_overlap_multiword_2(int i, int j, const TruthTables& truth_tables, int num_inputs, const uint64_t* care = nullptr);
+  bool solve_resub_overlap_multiword_3(int i, int j, int k, const TruthTables& truth_tables, int num_inputs, const uint64_t* care = nullptr);
 
   // Exposed for tests: enumerate all feasible 4-input combinations
-  void find_feasible_4resub(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets);
+  void find_feasible_4resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care = nullptr);
 
   // Exposed for tests: enumerate all feasible k-input combinations (k = 0..3)
-  void find_feasible_0resub(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets);
-  void find_feasible_1resub(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets);
-  void find_feasible_2resub(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets);
-  void find_feasible_3resub(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets);
+  void find_feasible_0resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care = nullptr);
+  void find_feasible_1resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care = nullptr);
+  void find_feasible_2resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care = nullptr);
+  void find_feasible_3resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care = nullptr);
+
+  // Visitor decision for each feasible combination found during enumeration
+  enum class FeasibleVisit {
+    ACCEPT,  // counted as a result, enumeration continues
+    REJECT,  // not counted, enumeration continues
+    STOP     // counted as a result, enumeration ends
+  };
+  using FeasibleVisitor = std::function<FeasibleVisit(const DivisorIndices&)>;
+
+  // Enumerate feasible k-combinations (k = 0..4) of divisors in lexicographic
+  // order and hand each to `visit`. Returns the number of counted results.
+  // find_feasible_{0..4}resub are built on this. With `order`, combinations are
+  // enumerated lexicographically over order[0..n-1] instead of 0..n-1; indices
+  // passed to the visitor are still sorted divisor indices.
+  int enumerate_feasible(const TruthTables& truth_tables, int num_inputs, int k, const FeasibleVisitor& visit, const std::vector<int>* order = nullptr, const uint64_t* care = nullptr);
+
+  // Divisor indices sorted by distinguishing power: the number of (onset, offset)
+  // minterm pairs of the target that the divisor separates, highest first
+  std::vector<int> order_divisors_by_distinguishing_power(const TruthTables& truth_tables, int num_inputs, const uint64_t* care = nullptr);
+
+  // Append at most n feasible k-combinations (first in enumeration order); returns how many
+  int find_feasible_first_n(const TruthTables& truth_tables, int num_inputs, int k, int n, std::vector<FeasibleSet>& out_sets, const uint64_t* care = nullptr);
+
+  // Ranking cost of a feasible combination (lower is better)
+  using FeasibleCost = std::function<int(const DivisorIndices&)>;
+
+  // Append the n lowest-cost feasible k-combinations, sorted by cost (ties keep
+  // enumeration order). A bounded heap keeps memory at O(n) during enumeration.
+  int find_feasible_best_n(const TruthTables& truth_tables, int num_inputs, int k, int n, const FeasibleCost& cost, std::vector<FeasibleSet>& out_sets, const uint64_t* care = nullptr);
 
   // (Note) Internal helpers for feasibility can remain in the .cpp; no header exposure needed.
 
@@ -30,10 +64,78 @@ namespace fresub {
   // For each window, test exactly K=min(4, #divisors) inputs (or fewer if #divisors < 4)
   void feasibility_check_cpu_all(std::vector<Window>::iterator it, std::vector<Window>::iterator end);
 
+  // CPU feasibility: ALL mode bounded to the max_sets best sets per window,
+  // ranked by the sum of divisor levels (`levels` indexed by global node id)
+  void feasibility_check_cpu_all_top(std::vector<Window>::iterator it, std::vector<Window>::iterator end, int max_sets, const std::vector<int>& levels);
+
   // CPU feasibility: MIN-SIZE mode
   // For each window, try k=0,1,2,3,4 (bounded by #divisors) and stop at first non-empty set
   void feasibility_check_cpu_min(std::vector<Window>::iterator it, std::vector<Window>::iterator end);
 
+  // 4-resub restricted to one AND/OR of two "double divisors" AND(d_a^p, d_b^q).
+  // Double divisors unate w.r.t. the target (contained in or disjoint from its
+  // onset or offset) are paired with the 2-resub kernel; each match carries its
+  // 3-gate structure in FeasibleSet::synth (inputs in divisor_indices order).
+  // Appends one set per divisor combination; returns how many.
+  int find_feasible_double_divisor_resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care = nullptr);
+
+  // CPU feasibility: MIN-SIZE mode trying double divisors before 4-resub
+  void feasibility_check_cpu_min_virtual(std::vector<Window>::iterator it, std::vector<Window>::iterator end);
+
+  // Number of k-combinations of n elements
+  uint64_t combination_count(int n, int k);
+
+  // Colexicographic rank of a sorted combination among all C(n, k) combinations
+  uint64_t combination_rank(const DivisorIndices& combination);
+
+  // Inverse of combination_rank for combinations of size k
+  DivisorIndices combination_unrank(uint64_t rank, int k);
+
+  // CPU feasibility: ALL mode with bitmap output
+  // Same combinations as feasibility_check_cpu_all, but records them as bits of
+  // window.feasible_bitmap (indexed by combination_rank) instead of FeasibleSets
+  void feasibility_check_cpu_all_bitmap(std::vector<Window>::iterator it, std::vector<Window>::iterator end);
+
+  // Materialize window.feasible_bitmap into window.feasible_sets and release the bitmap
+  void expand_feasible_bitmap(Window& window);
+
+  // CPU feasibility: FIRST mode
+  // For each window, try k=0,1,2,3,4 with divisors ordered by distinguishing
+  // power and stop at the first feasible set
+  void feasibility_check_cpu_first(std::vector<Window>::iterator it, std::vector<Window>::iterator end);
+
+  // CUDA feasibility: first (or all) feasible 4-divisor sets per window. The
+  // windows are flattened on the host (cuda_feasibility.cpp) into the layout
+  // of cuda_problems.hpp, so the kernels never see Window.
+  void feasibility_check_cuda(std::vector<Window>::iterator it, std::vector<Window>::iterator end);
+  void feasibility_check_cuda_all(std::vector<Window>::iterator it, std::vector<Window>::iterator end);
+
+  // Cross-window feasibility result cache. Windows with the same target truth
+  // table and the same multiset of divisor truth tables share one result, kept
+  // with divisors in canonical order (sorted by truth table).
+  class FeasibilityCache {
+  public:
+    // On a hit, fill window.feasible_sets mapped to the window's divisor order
+    bool lookup(Window& window);
+    // Record window.feasible_sets as the result for the window's function
+    void insert(const Window& window);
+
+    size_t hits = 0;
+    size_t misses = 0;
+
+  private:
+    struct Entry {
+      std::vector<uint64_t> key;             // full canonical key, checked on every hit
+      std::vector<DivisorIndices> sets;      // canonical divisor positions
+    };
+    std::unordered_map<uint64_t, std::vector<Entry>> table;
+  };
+
+  using FeasibilityCheck = std::function<void(std::vector<Window>::iterator, std::vector<Window>::iterator)>;
+
+  // Run `check` one window at a time, skipping windows whose function is cached
+  void feasibility_check_cached(std::vector<Window>::iterator it, std::vector<Window>::iterator end, FeasibilityCache& cache, const FeasibilityCheck& check);
+
   // CUDA feasibility check with vector iterator interface (original - finds first solution)
   void feasibility_check_cuda(std::vector<Window>::iterator begin, std::vector<Window>::iterator end);
 
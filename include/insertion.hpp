@@ -8,7 +8,15 @@
 namespace fresub {
 
   // Process windows directly using a gain-ordered heap over feasible sets.
+  // Candidates are popped in batches of batch_size whose current gain and
+  // acyclicity are evaluated in parallel, then committed sequentially in gain
+  // order; a candidate is re-checked only if an earlier commit of its batch
+  // touched its region. batch_size 1 is the plain serial loop.
+  // With speculative, a batch is instead committed without re-evaluation
+  // through an AigJournal and rolled back (then committed with re-evaluation)
+  // if its actual gain falls short of the predicted one.
   // Returns number of applied resubstitutions.
-  int inserter_process_windows_heap(aigman& aig, std::vector<Window>& windows, bool verbose = false);
+  int inserter_process_windows_heap(aigman& aig, std::vector<Window>& windows, bool verbose = false,
+                                    int batch_size = 1, int num_threads = 1, bool speculative = false);
 
 } // namespace fresub
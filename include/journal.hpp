@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <aig.hpp>
+
+namespace fresub {
+
+  // Replacement circuit small enough to keep inline, numbered like a
+  // synthesized aigman: 0 is the constant, 1..num_inputs the inputs, then
+  // the gates in topological order
+  struct TinyCircuit {
+    static constexpr int MAX_INPUTS = 4;
+    static constexpr int MAX_GATES = 3;
+    int num_inputs = 0;
+    int num_gates = 0;
+    int fanins[2 * MAX_GATES] = {};  // literals, 2 per gate
+    int output = 0;                  // literal
+
+    // Compact a single-output synth; false if it is too large
+    static bool from_aig(const aigman& synth, TinyCircuit& circuit);
+  };
+
+  // Undo log for node replacements. Each replacement rewires the target's
+  // fanouts and POs to a copy of a synthesized circuit and removes the logic
+  // left without fanouts, like aig.import, while recording fanin, PO,
+  // fanout-list and dead-mark changes. Rollback restores the AIG in time
+  // proportional to the recorded changes, without copying the aigman.
+  // Requires fanouts (aig.supportfanouts()).
+  class AigJournal {
+  public:
+    explicit AigJournal(aigman& aig);
+    AigJournal(const AigJournal&) = delete;
+    AigJournal& operator=(const AigJournal&) = delete;
+
+    // Replace target by the PO of synth, whose PI i is inputs[i]. Returns the
+    // number of gates saved, or -1 without changing the AIG if the result
+    // needs simplification (constant driver, or a gate whose fanins would both
+    // be on one node); use aig.import for those.
+    int replace(const aigman& synth, const std::vector<int>& inputs, int target);
+    int replace(const TinyCircuit& circuit, const std::vector<int>& inputs, int target);
+
+    // Keep every change since the last commit
+    void commit();
+
+    // Undo every change since the last commit
+    void rollback();
+
+    size_t changes() const { return log.size(); }
+
+  private:
+    enum class Op : uint8_t { FANIN, PO, DEAD, FANOUT_ADD, FANOUT_ERASE };
+    struct Entry {
+      Op op;
+      int node;   // node, or PO index for Op::PO
+      int pos;    // fanin slot or fanout list position
+      int value;  // previous fanin/PO literal, or the fanout
+    };
+
+    bool needs_simplification(int num_inputs, int num_gates, const int* fanins, int output,
+                              const std::vector<int>& inputs, int target) const;
+    int replace_gates(int num_inputs, int num_gates, const int* fanins, int output,
+                      const std::vector<int>& inputs, int target);
+    void set_fanin(int node, int slot, int lit);
+    void add_fanout(int node, int fanout);
+    void erase_fanout(int node, int fanout);
+    void kill(int node);
+
+    aigman& aig;
+    std::vector<Entry> log;
+    std::vector<int> lits;   // synth node -> AIG literal during replace
+    std::vector<int> stack;  // kill worklist
+    int base_objs;
+    int base_gates;
+    bool base_sorted;
+  };
+
+} // namespace fresub
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace fresub {
+
+  // CPUs of each NUMA node, read from /sys/devices/system/node. Machines
+  // without that directory (or with one node) get a single node holding no
+  // CPU list, and pinning is skipped.
+  struct NumaTopology {
+    std::vector<std::vector<int>> node_cpus;
+
+    int num_nodes() const { return std::max(1, static_cast<int>(node_cpus.size())); }
+    static const NumaTopology& system();
+  };
+
+  // Pin the calling thread to the CPUs of node and make it the thread's
+  // node; returns false if the affinity could not be set (the node is still
+  // recorded)
+  bool numa_bind_thread(const NumaTopology& topology, int node);
+
+  // Node recorded by numa_bind_thread for the calling thread (0 if unbound)
+  int numa_current_node();
+
+  // Items run by a numa_parallel_for and items taken from another node's queue
+  struct NumaStats {
+    size_t items = 0;
+    size_t steals = 0;
+
+    void add(const NumaStats& o) {
+      items += o.items;
+      steals += o.steals;
+    }
+  };
+
+  // Call body(i) for every i in [begin, end) on num_threads workers spread
+  // round-robin over the nodes and pinned there. Item i is queued on node
+  // home(i) (a negative home spreads the range over the nodes in contiguous
+  // blocks). Workers drain their node's queue first and then steal from the
+  // other nodes; stolen items are counted in stats. The caller only waits, so
+  // its own affinity is left alone. Runs inline, unpinned, when one thread
+  // suffices.
+  template <typename H, typename F>
+  void numa_parallel_for(int begin, int end, int num_threads, const NumaTopology& topology, const H& home, const F& body,
+                         NumaStats* stats = nullptr) {
+    int n = end - begin;
+    if (n <= 0) return;
+    if (stats) stats->items += n;
+    int threads = std::max(1, std::min(num_threads, n));
+    if (threads == 1) {
+      for (int i = begin; i < end; i++) body(i);
+      return;
+    }
+
+    // Per-node queues of item indices, in index order
+    int num_nodes = topology.num_nodes();
+    std::vector<int> offsets(num_nodes + 1, 0);
+    std::vector<int> nodes(n);
+    for (int i = 0; i < n; i++) {
+      int node = home(begin + i);
+      if (node < 0) node = static_cast<int>(static_cast<long long>(i) * num_nodes / n);
+      nodes[i] = node % num_nodes;
+      offsets[nodes[i] + 1]++;
+    }
+    for (int node = 0; node < num_nodes; node++) offsets[node + 1] += offsets[node];
+    std::vector<int> queue(n);
+    {
+      std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+      for (int i = 0; i < n; i++) queue[fill[nodes[i]]++] = begin + i;
+    }
+    std::unique_ptr<std::atomic<int>[]> next(new std::atomic<int>[num_nodes]);
+    for (int node = 0; node < num_nodes; node++) next[node].store(offsets[node], std::memory_order_relaxed);
+
+    std::atomic<size_t> steals(0);
+    auto worker = [&](int t) {
+      int own = t % num_nodes;
+      numa_bind_thread(topology, own);
+      size_t stolen = 0;
+      for (int d = 0; d < num_nodes; d++) {
+        int node = (own + d) % num_nodes;
+        for (int q = next[node]++; q < offsets[node + 1]; q = next[node]++) {
+          body(queue[q]);
+          stolen += d != 0;
+        }
+      }
+      steals += stolen;
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (int t = 0; t < threads; t++) workers.emplace_back(worker, t);
+    for (auto& w : workers) w.join();
+    if (stats) stats->steals += steals.load();
+  }
+
+} // namespace fresub
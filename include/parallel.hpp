@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace fresub {
+
+  // Default worker count: hardware concurrency (at least 1)
+  inline int default_num_threads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // Split [begin, end) into one contiguous chunk per thread and call
+  // body(chunk_begin, chunk_end, thread_id) for each. Chunks are ordered by
+  // thread_id, so per-thread results concatenated in that order follow the
+  // serial order. Runs inline when one thread suffices.
+  template <typename F>
+  void parallel_for_chunks(int begin, int end, int num_threads, int min_chunk, const F& body) {
+    int n = end - begin;
+    if (n <= 0) return;
+    int threads = std::max(1, std::min(num_threads, n / std::max(1, min_chunk)));
+    if (threads == 1) {
+      body(begin, end, 0);
+      return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int t = 1; t < threads; t++) {
+      int b = begin + static_cast<int>(static_cast<long long>(n) * t / threads);
+      int e = begin + static_cast<int>(static_cast<long long>(n) * (t + 1) / threads);
+      workers.emplace_back([&body, b, e, t]() { body(b, e, t); });
+    }
+    body(begin, begin + n / threads, 0);
+    for (auto& w : workers) w.join();
+  }
+
+  // Call body(i) for every i in [begin, end); threads take the next index
+  // when done, which balances items of very different cost.
+  template <typename F>
+  void parallel_for(int begin, int end, int num_threads, const F& body) {
+    int threads = std::max(1, std::min(num_threads, end - begin));
+    if (threads == 1) {
+      for (int i = begin; i < end; i++) body(i);
+      return;
+    }
+    std::atomic<int> next(begin);
+    auto worker = [&]() {
+      for (int i = next++; i < end; i = next++) body(i);
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int t = 1; t < threads; t++) workers.emplace_back(worker);
+    worker();
+    for (auto& w : workers) w.join();
+  }
+
+} // namespace fresub
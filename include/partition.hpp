@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <aig.hpp>
+
+namespace fresub {
+
+  // How gates are grouped into regions
+  enum class PartitionMode {
+    LEVELS,  // consecutive gates in (level, id) order
+    CONES    // depth-first transitive fanin cones of the POs, in PO order
+  };
+
+  // A region of the AIG. Regions are numbered so that every input is a PI,
+  // the constant, or a gate of an earlier region.
+  struct Partition {
+    std::vector<int> gates;    // global gate ids, topological order
+    std::vector<int> inputs;   // nodes outside the region feeding it
+    std::vector<int> outputs;  // region gates used outside it or by POs
+  };
+
+  // Split the gates of a sorted AIG into regions of at most max_gates gates
+  std::vector<Partition> partition_aig(const aigman& aig, int max_gates, PartitionMode mode);
+
+  // Region as a standalone AIG: PI i is part.inputs[i], PO k is part.outputs[k]
+  aigman* extract_partition(const aigman& aig, const Partition& part);
+
+  // Rebuild aig from the (optimized) region AIGs, in region order. Logic no
+  // longer reachable from the POs is dropped; the result is sorted.
+  void stitch_partitions(aigman& aig, const std::vector<Partition>& parts, const std::vector<aigman*>& subs);
+
+  using PartitionOptimizer = std::function<void(aigman&)>;
+
+  // Partition, run `optimize` on each region on num_threads threads, and
+  // stitch the results back into aig. Returns the number of regions.
+  int optimize_partitioned(aigman& aig, int max_gates, PartitionMode mode, int num_threads, const PartitionOptimizer& optimize);
+
+} // namespace fresub
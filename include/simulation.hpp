@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 
 #include "window.hpp"
 
@@ -12,4 +13,27 @@ namespace fresub {
   // - results[n] = target truth table (at the end)
   std::vector<std::vector<uint64_t>> compute_truth_tables_for_window(aigman const& aig, Window const& window, bool verbose);
 
+  // Observability don't-cares of the window target. The target is flipped and
+  // its TFO inside the window is resimulated up to max_depth levels; a pattern
+  // is a care pattern if a region node with fanouts outside the window (or
+  // beyond the depth limit) changes. Sets window.care (left empty when every
+  // pattern is care or max_depth <= 0) and flags the region nodes whose
+  // function may change under a care-mask replacement as WindowSnapshot::ODC.
+  void compute_window_care(Window& window, int max_depth);
+
+  // Whole-AIG simulation: num_words words per node (flat, node-major). PIs get
+  // uniform random words and words biased towards 0 or 1. Requires a sorted AIG.
+  std::vector<uint64_t> simulate_aig_random(aigman const& aig, int num_words, uint64_t seed);
+
+  struct SdcStats {
+    int windows_with_sdc = 0;  // windows whose care mask gained satisfiability don't-cares
+    int unconfirmed = 0;       // unseen leaf combinations left as care (TFI support too large)
+  };
+
+  // Satisfiability don't-cares of window leaves. Leaf combinations never seen in
+  // a global random simulation (num_words words) are confirmed impossible by
+  // exhaustive simulation of the leaves' TFI when its PI support has at most
+  // max_support inputs, then removed from window.care.
+  SdcStats compute_window_sdc(aigman const& aig, std::vector<Window>& windows, int num_words, int max_support);
+
 } // namespace fresub
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "window.hpp"
+
+namespace fresub {
+
+  // Out-of-core window storage for --spill, in an unlinked temporary file.
+  // Windows are appended in segments (one per batch) holding their structure
+  // (leaves, nodes, divisors, MFFC size, local snapshot), care masks, ODC
+  // flags and synthesized feasible sets as candidate records (candidates.hpp).
+  // Truth tables are not stored; insertion does not need them. Segments are
+  // written with pwrite and read back through a read-only mapping.
+  class SpillFile {
+  public:
+    // A run of windows in the file
+    struct Segment {
+      size_t offset = 0;
+      size_t size = 0;
+    };
+
+    SpillFile() = default;
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+    ~SpillFile();
+
+    // Create the temporary file in directory dir. Returns false (with a
+    // message on stderr) if it cannot be created.
+    bool open(const std::string& dir);
+
+    // Write windows [begin, end) as one segment. Returns false (with a message
+    // on stderr) on write errors.
+    bool append(std::vector<Window>::const_iterator begin, std::vector<Window>::const_iterator end, Segment& segment);
+
+    // Read a segment back, appending its windows to windows. Returns the
+    // number of candidates, or -1 (with a message on stderr) on errors.
+    int load(const Segment& segment, std::vector<Window>& windows);
+
+    size_t size() const { return file_size; }
+
+  private:
+    static constexpr size_t CHUNK_BYTES = size_t(8) << 20;  // largest single write
+
+    int fd = -1;
+    size_t file_size = 0;
+    std::vector<unsigned char> buffer;  // encoding scratch, reused across segments
+  };
+
+} // namespace fresub
@@ -4,11 +4,14 @@
 #include <vector>
 
 #include <aig.hpp>
+#include "window.hpp"
 
 namespace fresub {
 
   // Convert truth tables to exopt binary relation format
-  void generate_relation(const std::vector<std::vector<uint64_t>>& truth_tables, const std::vector<int>& selected_divisors, int num_inputs, std::vector<std::vector<bool>>& br);
+  // Patterns outside the optional care mask leave the relation unconstrained
+  void generate_relation(const TruthTables& truth_tables, const std::vector<int>& selected_divisors, int num_inputs, std::vector<std::vector<bool>>& br, const uint64_t* care = nullptr);
+  void generate_relation(const TruthTables& truth_tables, const DivisorIndices& selected_divisors, int num_inputs, std::vector<std::vector<bool>>& br, const uint64_t* care = nullptr);
   
   // Synthesize optimal circuit from binary relation (exopt-based)
   // Returns synthesized aigman* or nullptr if synthesis fails
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.hpp"
+
+namespace fresub {
+
+  // Hash-consed, reference-counted truth-table rows. Equal contents are stored
+  // once, so a divisor function seen from many overlapping windows costs one
+  // copy and equal rows have equal pointers. Rows live in slab chunks carved
+  // from a huge-page arena and never move; a row's word count sits in the
+  // slab just before its words.
+  // Each NUMA node (numa_current_node() of the interning thread) has its own
+  // arena and chunks, so rows are first touched, and placed, on that node.
+  // Released rows are reused for rows of the same size and node.
+  // Thread-safe: each shard (picked by hash) has its own lock.
+  class TruthTableStore {
+  public:
+    struct Stats {
+      size_t rows = 0;      // live distinct rows
+      size_t words = 0;     // words held by live rows
+      size_t interned = 0;  // intern calls
+      size_t shared = 0;    // intern calls answered by an existing row
+    };
+
+    TruthTableStore() = default;
+    TruthTableStore(const TruthTableStore&) = delete;
+    TruthTableStore& operator=(const TruthTableStore&) = delete;
+
+    // Store used by TruthTables
+    static TruthTableStore& global();
+
+    // Return the row equal to words[0..num_words), adding a reference
+    const uint64_t* intern(const uint64_t* words, uint32_t num_words);
+    void retain(const uint64_t* row);
+    void release(const uint64_t* row);
+
+    static uint32_t row_size(const uint64_t* row) { return static_cast<uint32_t>(row[-2]); }
+    // Node whose arena holds the row
+    static int row_node(const uint64_t* row) { return static_cast<int>(row[-2] >> 32); }
+
+    Stats stats();
+    // Summed over the node arenas (peak_bytes: sum of the per-node peaks)
+    HugePageArena::Stats arena_stats();
+
+    // Drop every slab chunk and unmap the arena if no row is live (between
+    // passes). Returns false if rows are still referenced.
+    bool release_memory();
+
+  private:
+    // Row layout in a chunk: [hash][node << 32 | num_words][refs][words...];
+    // refs change only under the shard lock, the rest is fixed while the row
+    // is live
+    static constexpr int NUM_SHARDS = 16;
+    static constexpr int MAX_NODES = 8;  // higher nodes share arenas modulo MAX_NODES
+    static constexpr size_t CHUNK_WORDS = size_t(1) << 13;
+    struct Chunk {
+      uint64_t* words = nullptr;  // current slab chunk (arena memory)
+      size_t used = CHUNK_WORDS;
+      size_t size = CHUNK_WORDS;
+    };
+    struct Shard {
+      std::mutex mutex;
+      std::unordered_multimap<uint64_t, uint64_t*> index;            // hash -> rows
+      std::unordered_map<uint64_t, std::vector<uint64_t*>> free_rows;  // row[-2] -> released rows
+      Chunk chunks[MAX_NODES];
+      Stats stats;
+    };
+
+    static uint64_t hash_words(const uint64_t* words, uint32_t num_words);
+    Shard& shard_of(uint64_t hash) { return shards[hash >> 60]; }
+    uint64_t* allocate(Shard& shard, uint32_t num_words, int node);
+
+    HugePageArena arenas[MAX_NODES];
+    Shard shards[NUM_SHARDS];
+  };
+
+  // One interned row: a pointer into the store with vector-like read access
+  class TruthTableRow {
+  public:
+    TruthTableRow() = default;
+    explicit TruthTableRow(const uint64_t* row) : row(row) {}
+
+    size_t size() const { return row ? TruthTableStore::row_size(row) : 0; }
+    uint64_t operator[](size_t w) const { return row[w]; }
+    const uint64_t* data() const { return row; }
+    const uint64_t* begin() const { return row; }
+    const uint64_t* end() const { return row + size(); }
+
+    // Rows of one store are equal iff they are the same row
+    bool operator==(const TruthTableRow& o) const { return row == o.row; }
+    bool operator!=(const TruthTableRow& o) const { return row != o.row; }
+    // Content order, as for std::vector<uint64_t>
+    bool operator<(const TruthTableRow& o) const;
+
+  private:
+    const uint64_t* row = nullptr;
+  };
+
+  // Truth tables of a window (divisors, then the target) as handles to rows of
+  // TruthTableStore::global(). Converts implicitly from owned tables.
+  class TruthTables {
+  public:
+    using const_iterator = std::vector<TruthTableRow>::const_iterator;
+
+    TruthTables() = default;
+    TruthTables(const std::vector<std::vector<uint64_t>>& tables) { assign(tables); }
+    TruthTables(std::initializer_list<std::vector<uint64_t>> tables);
+    TruthTables(const TruthTables& o);
+    TruthTables(TruthTables&& o) noexcept : rows(std::move(o.rows)) { o.rows.clear(); }
+    TruthTables& operator=(const TruthTables& o);
+    TruthTables& operator=(TruthTables&& o) noexcept;
+    ~TruthTables() { clear(); }
+
+    void assign(const std::vector<std::vector<uint64_t>>& tables);
+    void push_back(const uint64_t* words, uint32_t num_words);
+    void clear();
+
+    size_t size() const { return rows.size(); }
+    bool empty() const { return rows.empty(); }
+    TruthTableRow operator[](size_t i) const { return rows[i]; }
+    TruthTableRow back() const { return rows.back(); }
+    const_iterator begin() const { return rows.begin(); }
+    const_iterator end() const { return rows.end(); }
+
+    bool operator==(const TruthTables& o) const { return rows == o.rows; }
+    bool operator!=(const TruthTables& o) const { return rows != o.rows; }
+
+  private:
+    std::vector<TruthTableRow> rows;
+  };
+
+} // namespace fresub
@@ -1,17 +1,60 @@
 #pragma once
 
+#include <cassert>
 #include <cstdint>
+#include <initializer_list>
 #include <unordered_set>
 #include <vector>
 
 #include <aig.hpp>
 #include <cut.hpp>
 
+#include "aig_snapshot.hpp"
+#include "cut_enum.hpp"
+#include "truth_table_store.hpp"
+
 namespace fresub {
 
+  // Up to 4 divisor indices stored inline, so a feasible set owns no heap memory
+  struct DivisorIndices {
+    uint16_t idx[4] = {0, 0, 0, 0};
+    uint8_t count = 0;
+
+    DivisorIndices() = default;
+    DivisorIndices(std::initializer_list<int> list) {
+      for (int i : list) push_back(i);
+    }
+    void push_back(int i) {
+      assert(count < 4 && i >= 0 && i <= UINT16_MAX);
+      idx[count++] = static_cast<uint16_t>(i);
+    }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    int operator[](size_t i) const { return idx[i]; }
+    const uint16_t* begin() const { return idx; }
+    const uint16_t* end() const { return idx + count; }
+  };
+
   struct FeasibleSet {
-    std::vector<int> divisor_indices; // indices into window.divisors
-    std::vector<aigman*> synths;      // synthesized subcircuits for this set
+    aigman* synth = nullptr;          // synthesized subcircuit for this set
+    int window_id = -1;               // cut_id of the owning window
+    DivisorIndices divisor_indices;   // indices into window.divisors
+  };
+
+  // Window-local compact AIG. Local node ids 0..n-1 follow window.nodes
+  // (topological order), so every per-window pass touches one contiguous region.
+  struct WindowSnapshot {
+    // ODC: function may change when the target is replaced under window.care
+    enum : uint8_t { INPUT = 1, DIVISOR = 2, MFFC = 4, TFO = 8, ODC = 16 };
+    std::vector<int> fanins;          // 2 local literals per node (-1 for inputs)
+    std::vector<int> fanout_offsets;  // CSR offsets into fanout_indices (size n+1)
+    std::vector<int> fanout_indices;  // local fanouts restricted to the window
+    std::vector<int> refs;            // global fanout count per node
+    std::vector<uint8_t> flags;       // INPUT | DIVISOR | MFFC | TFO | ODC
+    std::vector<int> inputs;          // local ids of window.inputs (same order)
+    std::vector<int> divisors;        // local ids of window.divisors (same order)
+    std::vector<int> mffc_below;      // MFFC nodes outside the window (global ids)
+    int target = -1;                  // local id of the target
   };
 
   struct Window {
@@ -21,14 +64,86 @@ namespace fresub {
     std::vector<int> divisors;   // Window nodes - MFFC(target)
     int cut_id;                  // ID of the cut that generated this window
     int mffc_size;
-    std::vector<std::vector<uint64_t>> truth_tables;
+    TruthTables truth_tables;    // divisors, then the target (interned rows)
+    std::vector<uint64_t> care;  // ODC care mask over window patterns (empty = all care)
     std::vector<FeasibleSet> feasible_sets; // optional: enriched storage per feasible set
+    std::vector<uint64_t> feasible_bitmap;  // optional (ALL mode): bit r <=> combination of rank r is feasible
+    int feasible_k = 0;                     // combination size covered by feasible_bitmap
+    WindowSnapshot local;        // compact local structure built during extraction
+    int numa_node = -1;          // node that simulated the window (--numa), -1 if not yet
+  };
+
+  // Processing order of extracted windows
+  enum class WindowOrder {
+    CUT_ID,   // global cut-ID order (enumeration order)
+    LEVEL,    // by target level, then target id
+    LOCALITY  // Z-order over (target id, smallest leaf id)
   };
 
   // Extract all windows using exopt's cut enumeration.
+  // Equivalent to window_enumerate_all followed by window_analyze_all.
   void window_extract_all(aigman& aig, int max_cut_size, bool verbose, std::vector<Window>& windows);
 
+  // Enumerate cuts and fill target_node, inputs, nodes and cut_id of each window.
+  // The AigSnapshot versions of this and the following stages take a snapshot
+  // of the same AIG built once by the caller; the aigman versions build one.
+  void window_enumerate_all(aigman& aig, int max_cut_size, bool verbose, std::vector<Window>& windows);
+  void window_enumerate_all(aigman& aig, const AigSnapshot& snapshot, int max_cut_size, bool verbose, std::vector<Window>& windows);
+
+  // Same as window_enumerate_all with fresub's own cut enumerator (cut_enum.hpp):
+  // dominance-free cuts, at most max_cuts_per_node per target, enumerated on
+  // num_threads threads. Windows are numbered in target order as above.
+  void window_enumerate_all_native(aigman& aig, int max_cut_size, int max_cuts_per_node, int num_threads, bool verbose, std::vector<Window>& windows);
+  void window_enumerate_all_native(const AigSnapshot& aig, int max_cut_size, int max_cuts_per_node, int num_threads, bool verbose, std::vector<Window>& windows);
+
+  // Windows of a run of targets at a time, for --spill: cuts are enumerated
+  // once up front, but only the windows of the current run exist. Windows
+  // are numbered as window_enumerate_all(_native) numbers them.
+  class WindowStream {
+  public:
+    // exopt's cut enumeration (as window_enumerate_all)
+    WindowStream(aigman& aig, const AigSnapshot& snapshot, int max_cut_size, bool verbose);
+    // fresub's cut enumeration (as window_enumerate_all_native)
+    WindowStream(const AigSnapshot& snapshot, int max_cut_size, int max_cuts_per_node, int num_threads, bool verbose);
+    WindowStream(const WindowStream&) = delete;
+    WindowStream& operator=(const WindowStream&) = delete;
+
+    // Replace windows by those of the next whole targets, stopping once at
+    // least max_windows are taken. Fills target_node, inputs, nodes and
+    // cut_id. Returns false when all targets are done.
+    bool next(std::vector<Window>& windows, size_t max_windows);
+
+  private:
+    const AigSnapshot& snapshot;
+    bool native;
+    std::vector<std::vector<Cut>> exopt_cuts;  // per target; released once taken
+    CutSet native_cuts;
+    int next_target;
+    int next_cut_id = 0;
+  };
+
+  // Build window.local and compute MFFC, TFO, divisors and mffc_size.
+  // Windows are analyzed independently on num_threads threads.
+  void window_analyze_all(aigman& aig, std::vector<Window>& windows);
+  void window_analyze_all(const AigSnapshot& aig, std::vector<Window>& windows, int num_threads);
+
+  // Reorder windows so consecutive windows touch nearby nodes. cut_id is kept.
+  void window_order(aigman const& aig, std::vector<Window>& windows, WindowOrder order);
+
   // TFO computation within window bounds (exposed for testing)
   std::unordered_set<int> compute_tfo_in_window(aigman& aig, int root, const std::vector<int>& window_nodes);
 
+  // Build the structural part of window.local (fanins, fanout CSR, inputs, target)
+  // from window.nodes/inputs/target_node. Divisor ids are filled if already known.
+  void build_window_snapshot(aigman const& aig, Window& window);
+  void build_window_snapshot(const AigSnapshot& aig, Window& window);
+
+  // Mark MFFC(target) on window.local using global reference counts; MFFC nodes
+  // outside the window are collected into local.mffc_below. Returns MFFC size.
+  // `deref` follows the same contract as in compute_mffc.
+  int mark_mffc_in_window(const AigSnapshot& aig, Window& window, std::vector<int>& deref);
+
+  // Mark TFO(target) on window.local using the local fanout CSR.
+  void mark_tfo_in_window(Window& window);
+
 } // namespace fresub
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "window.hpp"
+
+namespace fresub {
+
+  // On-disk cache of simulation and feasibility results across runs.
+  // Windows are keyed by a structural hash of their local cone (window.local:
+  // local fanins, divisor and target positions, fanout counts) plus a
+  // caller-chosen mode tag; mode 3 (virtual divisors) also keys on the MFFC
+  // size.
+  // The file is append-only: a header followed by self-delimiting records. It
+  // is memory-mapped on open; records appended during a run become visible to
+  // the next run. A truncated tail record (e.g. from an interrupted run) is
+  // dropped on open.
+  class WindowCache {
+  public:
+    WindowCache() = default;
+    WindowCache(const WindowCache&) = delete;
+    WindowCache& operator=(const WindowCache&) = delete;
+    ~WindowCache();
+
+    // Open or create the cache file. Returns false (with a message on stderr)
+    // if the file cannot be used.
+    bool open(const std::string& path);
+
+    // On a hit, fill window.truth_tables and window.feasible_sets
+    bool lookup(Window& window, uint32_t mode);
+
+    // Append the window's truth tables and feasible sets
+    void append(const Window& window, uint32_t mode);
+
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t appended = 0;
+
+  private:
+    // Fill window from the record at offset record if it matches key and mode.
+    // Records with out-of-range fields are treated as misses.
+    bool decode_record(size_t record, const std::vector<int32_t>& key, uint32_t mode, Window& window);
+
+    int fd = -1;
+    const unsigned char* data = nullptr;  // mapped file contents at open
+    size_t mapped_size = 0;
+    size_t file_size = 0;                 // append offset
+    std::unordered_map<uint64_t, std::vector<size_t>> index;  // hash -> record offsets
+    std::unordered_set<uint64_t> written;                     // hashes appended this run
+  };
+
+} // namespace fresub
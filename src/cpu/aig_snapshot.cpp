@@ -0,0 +1,75 @@
+#include "aig_snapshot.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "aig_utils.hpp"
+#include "parallel.hpp"
+
+namespace fresub {
+
+  void build_aig_snapshot(const aigman& aig, int num_threads, AigSnapshot& snapshot) {
+    int n = aig.nObjs;
+    snapshot.num_pis = aig.nPis;
+    snapshot.num_objs = n;
+    snapshot.pos = aig.vPos;
+    snapshot.fanins.assign(2 * static_cast<size_t>(n), -1);
+    snapshot.refs.assign(n, 0);
+    snapshot.fanout_offsets.assign(n + 1, 0);
+
+    // Fanins and fanout counts; counts are atomic since fanins are shared
+    std::unique_ptr<std::atomic<int>[]> counts(new std::atomic<int>[n]);
+    parallel_for_chunks(0, n, num_threads, 4096, [&](int b, int e, int) {
+      for (int node = b; node < e; node++) counts[node].store(0, std::memory_order_relaxed);
+    });
+    parallel_for_chunks(aig.nPis + 1, n, num_threads, 4096, [&](int b, int e, int) {
+      for (int node = b; node < e; node++) {
+        if (!is_node_accessible(aig, node)) continue;
+        for (int k = 0; k < 2; k++) {
+          int lit = aig.vObjs[node * 2 + k];
+          snapshot.fanins[node * 2 + k] = lit;
+          counts[lit2var(lit)].fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    });
+    for (int node = 0; node < n; node++) {
+      snapshot.fanout_offsets[node + 1] = snapshot.fanout_offsets[node] + counts[node].load(std::memory_order_relaxed);
+    }
+
+    // Fill in any order, then sort each list so the result is deterministic
+    snapshot.fanout_indices.resize(snapshot.fanout_offsets[n]);
+    parallel_for_chunks(0, n, num_threads, 4096, [&](int b, int e, int) {
+      for (int node = b; node < e; node++) counts[node].store(snapshot.fanout_offsets[node], std::memory_order_relaxed);
+    });
+    parallel_for_chunks(aig.nPis + 1, n, num_threads, 4096, [&](int b, int e, int) {
+      for (int node = b; node < e; node++) {
+        if (!snapshot.is_gate(node)) continue;
+        for (int k = 0; k < 2; k++) {
+          int fanin = lit2var(snapshot.fanins[node * 2 + k]);
+          snapshot.fanout_indices[counts[fanin].fetch_add(1, std::memory_order_relaxed)] = node;
+        }
+      }
+    });
+    parallel_for_chunks(0, n, num_threads, 4096, [&](int b, int e, int) {
+      for (int node = b; node < e; node++) {
+        std::sort(snapshot.fanout_indices.begin() + snapshot.fanout_offsets[node],
+                  snapshot.fanout_indices.begin() + snapshot.fanout_offsets[node + 1]);
+        snapshot.refs[node] = snapshot.fanout_offsets[node + 1] - snapshot.fanout_offsets[node];
+      }
+    });
+    for (int po : aig.vPos) snapshot.refs[lit2var(po)]++;
+
+    // Levels follow the id order, which is topological only when sorted
+    snapshot.levels.clear();
+    if (aig.fSorted) {
+      snapshot.levels.assign(n, 0);
+      for (int node = aig.nPis + 1; node < n; node++) {
+        if (!snapshot.is_gate(node)) continue;
+        snapshot.levels[node] = std::max(snapshot.levels[lit2var(snapshot.fanins[node * 2])],
+                                         snapshot.levels[lit2var(snapshot.fanins[node * 2 + 1])]) + 1;
+      }
+    }
+  }
+
+} // namespace fresub
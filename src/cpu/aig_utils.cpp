@@ -1,5 +1,6 @@
 #include "aig_utils.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <cassert>
 #include <queue>
@@ -12,6 +13,18 @@ bool is_node_accessible(const aigman& aig, int node) {
   return aig.vDeads.empty() || !aig.vDeads[node];
 }
 
+std::vector<int> compute_levels(const aigman& aig) {
+  assert(aig.fSorted);
+  std::vector<int> levels(aig.nObjs, 0);
+  for (int i = aig.nPis + 1; i < aig.nObjs; i++) {
+    if (!is_node_accessible(aig, i)) continue;
+    int l0 = levels[aig.vObjs[i * 2] >> 1];
+    int l1 = levels[aig.vObjs[i * 2 + 1] >> 1];
+    levels[i] = std::max(l0, l1) + 1;
+  }
+  return levels;
+}
+
 // Recursive helper for deref-based MFFC
 static void mffc_deref_dfs(aigman& aig,
                            int n,
@@ -0,0 +1,93 @@
+// Counting replacements of the global operator new/delete; linked into fresub
+// only with the FRESUB_ALLOC_STATS CMake option (see alloc_stats.hpp)
+#ifdef FRESUB_ALLOC_STATS
+
+#include "alloc_stats.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include <malloc.h>
+
+namespace {
+
+  std::atomic<uint64_t> g_allocations{0};
+  std::atomic<uint64_t> g_bytes{0};
+  std::atomic<uint64_t> g_live{0};
+  std::atomic<uint64_t> g_peak{0};
+
+  // Live bytes use the usable size, which is also known at free time
+  void count_alloc(void* p, size_t n) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_bytes.fetch_add(n, std::memory_order_relaxed);
+    uint64_t live = g_live.fetch_add(malloc_usable_size(p), std::memory_order_relaxed) + malloc_usable_size(p);
+    uint64_t peak = g_peak.load(std::memory_order_relaxed);
+    while (live > peak && !g_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+  }
+
+  void count_free(void* p) {
+    g_live.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+  }
+
+  void* counted_alloc(size_t n, size_t align) {
+    void* p = align <= alignof(std::max_align_t) ? std::malloc(n ? n : 1)
+                                                 : std::aligned_alloc(align, (std::max<size_t>(n, 1) + align - 1) / align * align);
+    if (p) count_alloc(p, n);
+    return p;
+  }
+
+  void counted_free(void* p) {
+    if (!p) return;
+    count_free(p);
+    std::free(p);
+  }
+
+} // namespace
+
+namespace fresub {
+
+  AllocCounters alloc_counters() {
+    AllocCounters c;
+    c.allocations = g_allocations.load(std::memory_order_relaxed);
+    c.bytes = g_bytes.load(std::memory_order_relaxed);
+    c.live_bytes = g_live.load(std::memory_order_relaxed);
+    c.peak_live_bytes = g_peak.load(std::memory_order_relaxed);
+    return c;
+  }
+
+  void alloc_reset_peak() {
+    g_peak.store(g_live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+} // namespace fresub
+
+void* operator new(size_t n) {
+  void* p = counted_alloc(n, 0);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t n) { return operator new(n); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return counted_alloc(n, 0); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return counted_alloc(n, 0); }
+void* operator new(size_t n, std::align_val_t align) {
+  void* p = counted_alloc(n, static_cast<size_t>(align));
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t n, std::align_val_t align) { return operator new(n, align); }
+
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { counted_free(p); }
+
+#endif // FRESUB_ALLOC_STATS
@@ -0,0 +1,64 @@
+#include "arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#include <sys/mman.h>
+
+namespace fresub {
+
+  bool HugePageArena::map_block(size_t min_bytes) {
+    size_t size = (std::max(block_bytes, min_bytes) + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+#ifdef MAP_HUGETLB
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      blocks.push_back({static_cast<char*>(p), size});
+      counters.huge_pages += size / HUGE_PAGE;
+      used = 0;
+      return true;
+    }
+#endif
+    // Without reserved huge pages: over-map by one huge page to align the
+    // block so transparent huge pages can back all of it
+    void* raw = mmap(nullptr, size + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return false;
+    char* start = static_cast<char*>(raw);
+    char* base = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(start) + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+    if (base > start) munmap(start, base - start);
+    if (base + size < start + size + HUGE_PAGE) munmap(base + size, start + size + HUGE_PAGE - (base + size));
+#ifdef MADV_HUGEPAGE
+    madvise(base, size, MADV_HUGEPAGE);
+#endif
+    blocks.push_back({base, size});
+    counters.thp_pages += size / HUGE_PAGE;
+    used = 0;
+    return true;
+  }
+
+  void* HugePageArena::allocate(size_t bytes, size_t align) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t offset = (used + align - 1) & ~(align - 1);
+    if (blocks.empty() || offset + bytes > blocks.back().size) {
+      if (!map_block(bytes)) return nullptr;
+      offset = 0;
+    }
+    used = offset + bytes;
+    counters.bytes += bytes;
+    counters.peak_bytes = std::max(counters.peak_bytes, counters.bytes);
+    return blocks.back().base + offset;
+  }
+
+  void HugePageArena::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const Block& block : blocks) munmap(block.base, block.size);
+    blocks.clear();
+    used = 0;
+    counters.bytes = 0;
+  }
+
+  HugePageArena::Stats HugePageArena::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+  }
+
+} // namespace fresub
@@ -0,0 +1,258 @@
+#include "candidates.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <unordered_map>
+
+namespace fresub {
+
+  // File layout:
+  //   header: "FRSCAND2", u64 fingerprint
+  //   record: u32 cut_id, u32 care_words, u64 care[care_words],
+  //           u32 n_odc, u32 odc[n_odc] (local node ids),
+  //           u32 n_sets, n_sets x set
+  //   set:    u8 count, u32 idx[count], u8 n_pis, u32 n_gates,
+  //           u32 fanins[2 * n_gates], u32 po (literals of the synthesized AIG)
+  // Counts are u32 so ALL mode on large cuts cannot wrap them (version 1
+  // used u16).
+  static const char kMagic[8] = {'F', 'R', 'S', 'C', 'A', 'N', 'D', '2'};
+
+  template <typename T>
+  static void put(std::vector<unsigned char>& out, T v) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&v);
+    out.insert(out.end(), p, p + sizeof(T));
+  }
+
+  template <typename T>
+  static bool get(const unsigned char*& p, const unsigned char* end, T& v) {
+    if (static_cast<size_t>(end - p) < sizeof(T)) return false;
+    std::memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+  }
+
+  static uint64_t mix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    return h;
+  }
+
+  bool in_shard(int cut_id, int shard, int num_shards) {
+    uint64_t h = static_cast<uint64_t>(cut_id) * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 31;
+    return static_cast<int>(h % static_cast<uint64_t>(num_shards)) == shard;
+  }
+
+  uint64_t candidate_fingerprint(const aigman& aig, uint64_t salt) {
+    uint64_t h = mix(salt, aig.nPis);
+    h = mix(h, aig.nPos);
+    h = mix(h, aig.nObjs);
+    for (int i = 2 * (aig.nPis + 1); i < 2 * aig.nObjs; i++) h = mix(h, aig.vObjs[i]);
+    for (int po : aig.vPos) h = mix(h, po);
+    return h;
+  }
+
+  void encode_candidate_records(std::vector<Window>::const_iterator begin, std::vector<Window>::const_iterator end,
+                                std::vector<unsigned char>& out) {
+    for (auto it = begin; it != end; ++it) {
+      const Window& window = *it;
+      uint32_t n_sets = 0;
+      for (const auto& fs : window.feasible_sets) n_sets += fs.synth != nullptr;
+      if (n_sets == 0) continue;
+      put<uint32_t>(out, window.cut_id);
+      put<uint32_t>(out, window.care.size());
+      for (uint64_t word : window.care) put<uint64_t>(out, word);
+      std::vector<uint32_t> odc;
+      for (size_t i = 0; i < window.local.flags.size(); i++) {
+        if (window.local.flags[i] & WindowSnapshot::ODC) odc.push_back(i);
+      }
+      put<uint32_t>(out, odc.size());
+      for (uint32_t i : odc) put<uint32_t>(out, i);
+      put<uint32_t>(out, n_sets);
+      for (const auto& fs : window.feasible_sets) {
+        if (!fs.synth) continue;
+        const aigman& synth = *fs.synth;
+        put<uint8_t>(out, fs.divisor_indices.size());
+        for (int idx : fs.divisor_indices) put<uint32_t>(out, idx);
+        put<uint8_t>(out, synth.nPis);
+        put<uint32_t>(out, synth.nObjs - synth.nPis - 1);
+        for (int i = 2 * (synth.nPis + 1); i < 2 * synth.nObjs; i++) put<uint32_t>(out, synth.vObjs[i]);
+        put<uint32_t>(out, synth.vPos[0]);
+      }
+    }
+  }
+
+  int decode_candidate_records(const unsigned char* data, size_t size, std::vector<Window>& windows) {
+    // Windows may have been reordered or thinned out (--shard); index them by cut ID
+    std::unordered_map<uint32_t, size_t> by_cut;
+    by_cut.reserve(windows.size());
+    for (size_t i = 0; i < windows.size(); i++) {
+      if (windows[i].cut_id >= 0) by_cut[windows[i].cut_id] = i;
+    }
+    const unsigned char* p = data;
+    const unsigned char* end = data + size;
+    int count = 0;
+    uint32_t cut_id;
+    while (p != end) {
+      if (!get(p, end, cut_id)) return -1;
+      auto found = by_cut.find(cut_id);
+      if (found == by_cut.end()) return -1;
+      Window& window = windows[found->second];
+      uint32_t care_words, n_odc, n_sets;
+      if (!get(p, end, care_words)) return -1;
+      if (care_words > static_cast<size_t>(end - p) / sizeof(uint64_t)) return -1;
+      window.care.resize(care_words);
+      for (auto& word : window.care) {
+        if (!get(p, end, word)) return -1;
+      }
+      if (!get(p, end, n_odc)) return -1;
+      for (uint32_t k = 0; k < n_odc; k++) {
+        uint32_t i;
+        if (!get(p, end, i) || i >= window.local.flags.size()) return -1;
+        window.local.flags[i] |= WindowSnapshot::ODC;
+      }
+      if (!get(p, end, n_sets)) return -1;
+      for (uint32_t s = 0; s < n_sets; s++) {
+        FeasibleSet fs;
+        fs.window_id = window.cut_id;
+        uint8_t size, n_pis;
+        uint32_t n_gates, po;
+        if (!get(p, end, size) || size > 4) return -1;
+        for (int k = 0; k < size; k++) {
+          uint32_t idx;
+          if (!get(p, end, idx) || idx >= window.divisors.size()) return -1;
+          fs.divisor_indices.push_back(idx);
+        }
+        if (!get(p, end, n_pis) || !get(p, end, n_gates) || n_pis != size) return -1;
+        aigman* synth = new aigman(n_pis, 1);
+        bool ok = true;
+        for (uint32_t g = 0; g < n_gates && ok; g++) {
+          uint32_t f0, f1;
+          ok = get(p, end, f0) && get(p, end, f1) && f0 < 2u * synth->nObjs && f1 < 2u * synth->nObjs;
+          if (ok) synth->newgate(f0, f1);
+        }
+        ok = ok && get(p, end, po) && po < 2u * synth->nObjs;
+        if (!ok) {
+          delete synth;
+          return -1;
+        }
+        synth->vPos[0] = po;
+        fs.synth = synth;
+        window.feasible_sets.push_back(fs);
+        count++;
+      }
+    }
+    return count;
+  }
+
+  bool write_candidates(const std::string& path, uint64_t fingerprint, const std::vector<Window>& windows) {
+    // Write to a temporary name so readers never see a partial file
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      std::cerr << "Error: cannot write candidate file " << tmp << "\n";
+      return false;
+    }
+    std::vector<unsigned char> buf(kMagic, kMagic + sizeof(kMagic));
+    put<uint64_t>(buf, fingerprint);
+    encode_candidate_records(windows.begin(), windows.end(), buf);
+    out.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+    out.close();
+    if (!out || std::rename(tmp.c_str(), path.c_str()) != 0) {
+      std::cerr << "Error: cannot write candidate file " << path << "\n";
+      return false;
+    }
+    return true;
+  }
+
+  int read_candidates(const std::string& path, uint64_t fingerprint, std::vector<Window>& windows) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<unsigned char> buf;
+    if (in) buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    const unsigned char* p = buf.data() + sizeof(kMagic);
+    const unsigned char* end = buf.data() + buf.size();
+    uint64_t file_fingerprint = 0;
+    if (!in || buf.size() < sizeof(kMagic) || std::memcmp(buf.data(), kMagic, sizeof(kMagic)) != 0 ||
+        !get(p, end, file_fingerprint)) {
+      std::cerr << "Error: " << path << " is not a fresub candidate file\n";
+      return -1;
+    }
+    if (file_fingerprint != fingerprint) {
+      std::cerr << "Error: " << path << " was written for a different AIG or cut settings\n";
+      return -1;
+    }
+    int count = decode_candidate_records(p, end - p, windows);
+    if (count < 0) std::cerr << "Error: candidate file " << path << " is truncated or corrupt\n";
+    return count;
+  }
+
+  size_t consolidate_candidates(std::vector<Window>& windows, int max_per_target) {
+    struct Ranked {
+      int target;
+      int gain;
+      int window;
+      long long set;  // index into feasible_sets, or -1 - rank of a bitmap entry
+    };
+    std::vector<Ranked> ranked;
+    for (size_t w = 0; w < windows.size(); w++) {
+      const Window& window = windows[w];
+      for (size_t i = 0; i < window.feasible_sets.size(); i++) {
+        const FeasibleSet& fs = window.feasible_sets[i];
+        int gates = fs.synth ? fs.synth->nGates : std::max<int>(0, fs.divisor_indices.size() - 1);
+        ranked.push_back(Ranked{window.target_node, window.mffc_size - gates, static_cast<int>(w), static_cast<long long>(i)});
+      }
+      int gain = window.mffc_size - std::max(0, window.feasible_k - 1);
+      for (size_t word = 0; word < window.feasible_bitmap.size(); word++) {
+        for (uint64_t bits = window.feasible_bitmap[word]; bits; bits &= bits - 1) {
+          long long rank = static_cast<long long>(word) * 64 + __builtin_ctzll(bits);
+          ranked.push_back(Ranked{window.target_node, gain, static_cast<int>(w), -1 - rank});
+        }
+      }
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const Ranked& a, const Ranked& b) {
+      return a.target != b.target ? a.target < b.target : a.gain > b.gain;
+    });
+
+    // Mark the kept entries, then rebuild each window's lists and bitmaps
+    std::vector<std::vector<char>> keep_sets(windows.size());
+    std::vector<std::vector<uint64_t>> keep_bits(windows.size());
+    for (size_t w = 0; w < windows.size(); w++) {
+      keep_sets[w].assign(windows[w].feasible_sets.size(), 0);
+      keep_bits[w].assign(windows[w].feasible_bitmap.size(), 0);
+    }
+    int kept = 0;
+    for (size_t i = 0; i < ranked.size(); i++) {
+      if (i == 0 || ranked[i].target != ranked[i - 1].target) kept = 0;
+      if (kept++ >= max_per_target) continue;
+      const Ranked& r = ranked[i];
+      if (r.set >= 0) {
+        keep_sets[r.window][r.set] = 1;
+      } else {
+        long long rank = -1 - r.set;
+        keep_bits[r.window][rank / 64] |= 1ull << (rank % 64);
+      }
+    }
+    size_t dropped = 0;
+    for (size_t w = 0; w < windows.size(); w++) {
+      Window& window = windows[w];
+      std::vector<FeasibleSet> sets;
+      for (size_t i = 0; i < window.feasible_sets.size(); i++) {
+        if (keep_sets[w][i]) {
+          sets.push_back(window.feasible_sets[i]);
+        } else {
+          delete window.feasible_sets[i].synth;
+          dropped++;
+        }
+      }
+      window.feasible_sets = std::move(sets);
+      for (size_t word = 0; word < window.feasible_bitmap.size(); word++) {
+        dropped += __builtin_popcountll(window.feasible_bitmap[word] & ~keep_bits[w][word]);
+      }
+      window.feasible_bitmap = std::move(keep_bits[w]);
+    }
+    return dropped;
+  }
+
+} // namespace fresub
@@ -0,0 +1,112 @@
+#include "feasibility.hpp"
+
+#include <cassert>
+#include <iterator>
+
+#include "cuda_problems.hpp"
+
+namespace fresub {
+
+  // Flatten the truth tables of windows [begin, end) for the kernels
+  static int flatten_problems(std::vector<Window>::iterator begin, std::vector<Window>::iterator end,
+                              std::vector<int>& problem_offsets, std::vector<int>& num_inputs,
+                              std::vector<uint64_t>& flat_problems) {
+    int M = std::distance(begin, end);
+    problem_offsets.assign(M + 1, 0);
+    num_inputs.assign(M, 0);
+    int total_elements = 0;
+    int idx = 0;
+    for (auto it = begin; it != end; ++it, ++idx) {
+      num_inputs[idx] = it->inputs.size();
+      int nWords = ((1 << num_inputs[idx]) + 63) / 64;
+      problem_offsets[idx] = total_elements;
+      total_elements += it->truth_tables.size() * nWords;  // divisors + target
+    }
+    problem_offsets[M] = total_elements;
+
+    flat_problems.assign(total_elements, 0);
+    idx = 0;
+    for (auto it = begin; it != end; ++it, ++idx) {
+      int nWords = ((1 << num_inputs[idx]) + 63) / 64;
+      for (size_t t = 0; t < it->truth_tables.size(); t++) {
+        TruthTableRow row = it->truth_tables[t];
+        for (int w = 0; w < nWords && w < static_cast<int>(row.size()); w++) {
+          flat_problems[problem_offsets[idx] + t * nWords + w] = row[w];
+        }
+      }
+    }
+    return total_elements;
+  }
+
+  void feasibility_check_cuda(std::vector<Window>::iterator begin, std::vector<Window>::iterator end) {
+    int M = std::distance(begin, end);
+    if (M == 0) return;
+    std::vector<int> problem_offsets, num_inputs;
+    std::vector<uint64_t> flat_problems;
+    int total_elements = flatten_problems(begin, end, problem_offsets, num_inputs, flat_problems);
+
+    // First feasible set only
+    std::vector<uint32_t> solutions(M);
+    cuda::solve_resub_problems_cuda(flat_problems.data(), solutions.data(),
+                                    problem_offsets.data(), num_inputs.data(), M, total_elements);
+
+    int idx = 0;
+    for (auto it = begin; it != end; ++it, ++idx) {
+      uint32_t mask = solutions[idx];
+      if (mask == 0) continue;
+      FeasibleSet fs;
+      for (int i = 0; i < 32; i++) {
+        if (mask & (1u << i)) fs.divisor_indices.push_back(i);
+      }
+      fs.window_id = it->cut_id;
+      it->feasible_sets.push_back(fs);
+    }
+  }
+
+  void feasibility_check_cuda_all(std::vector<Window>::iterator begin, std::vector<Window>::iterator end) {
+    int M = std::distance(begin, end);
+    if (M == 0) return;
+    std::vector<int> problem_offsets, num_inputs;
+    std::vector<uint64_t> flat_problems;
+    int total_elements = flatten_problems(begin, end, problem_offsets, num_inputs, flat_problems);
+
+    // D^4 result slots per window
+    std::vector<int> combination_offsets(M + 1);
+    int total_combinations = 0;
+    int idx = 0;
+    for (auto it = begin; it != end; ++it, ++idx) {
+      int n_divs = it->truth_tables.size() - 1;
+      combination_offsets[idx] = total_combinations;
+      total_combinations += n_divs * n_divs * n_divs * n_divs;
+    }
+    combination_offsets[M] = total_combinations;
+    std::vector<char> feasibility_results(total_combinations, 0);
+
+    cuda::solve_resub_problems_cuda_all(flat_problems.data(), feasibility_results.data(),
+                                        problem_offsets.data(), combination_offsets.data(),
+                                        num_inputs.data(), M, total_elements, total_combinations);
+
+    // Valid combinations are i < j < k < l
+    idx = 0;
+    for (auto it = begin; it != end; ++it, ++idx) {
+      int n_divs = it->truth_tables.size() - 1;
+      int combination_base = combination_offsets[idx];
+      assert(it->feasible_sets.empty());
+      for (int i = 0; i < n_divs; i++) {
+        for (int j = i + 1; j < n_divs; j++) {
+          for (int k = j + 1; k < n_divs; k++) {
+            for (int l = k + 1; l < n_divs; l++) {
+              int combination_idx = l + k * n_divs + j * n_divs * n_divs + i * n_divs * n_divs * n_divs;
+              if (!feasibility_results[combination_base + combination_idx]) continue;
+              FeasibleSet fs;
+              fs.divisor_indices = {i, j, k, l};
+              fs.window_id = it->cut_id;
+              it->feasible_sets.push_back(fs);
+            }
+          }
+        }
+      }
+    }
+  }
+
+} // namespace fresub
@@ -0,0 +1,142 @@
+#include "cut_enum.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "aig_utils.hpp"
+#include "parallel.hpp"
+
+namespace fresub {
+
+  static InlineCut trivial_cut(int node) {
+    InlineCut cut;
+    cut.leaves[0] = node;
+    cut.size = 1;
+    cut.signature = 1ull << (node % 64);
+    return cut;
+  }
+
+  // Merge two sorted leaf lists; false if the union exceeds max_size
+  static bool merge_cuts(const InlineCut& a, const InlineCut& b, int max_size, InlineCut& out) {
+    int i = 0, j = 0, n = 0;
+    while (i < a.size || j < b.size) {
+      int leaf;
+      if (j == b.size || (i < a.size && a.leaves[i] < b.leaves[j])) {
+        leaf = a.leaves[i++];
+      } else if (i == a.size || b.leaves[j] < a.leaves[i]) {
+        leaf = b.leaves[j++];
+      } else {
+        leaf = a.leaves[i++];
+        j++;
+      }
+      if (n == max_size) return false;
+      out.leaves[n++] = leaf;
+    }
+    out.size = static_cast<uint8_t>(n);
+    out.signature = a.signature | b.signature;
+    return true;
+  }
+
+  // True if every leaf of a is a leaf of b
+  static bool cut_subset(const InlineCut& a, const InlineCut& b) {
+    if (a.size > b.size || (a.signature & ~b.signature)) return false;
+    return std::includes(b.begin(), b.end(), a.begin(), a.end());
+  }
+
+  static bool cut_less(const InlineCut& a, const InlineCut& b) {
+    if (a.size != b.size) return a.size < b.size;
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+  }
+
+  // Dominance-free merged cuts of one node (without the trivial cut)
+  static void node_cuts(const AigSnapshot& aig, const CutSet& set, int node, int max_cut_size, int max_cuts, std::vector<InlineCut>& res) {
+    res.clear();
+    int fanin0 = lit2var(aig.fanins[node * 2]);
+    int fanin1 = lit2var(aig.fanins[node * 2 + 1]);
+    InlineCut merged;
+    for (const InlineCut* a = set.node_begin(fanin0); a != set.node_end(fanin0); ++a) {
+      for (const InlineCut* b = set.node_begin(fanin1); b != set.node_end(fanin1); ++b) {
+        if (__builtin_popcountll(a->signature | b->signature) > max_cut_size) continue;
+        if (!merge_cuts(*a, *b, max_cut_size, merged)) continue;
+        bool dominated = false;
+        for (const InlineCut& c : res) {
+          if (cut_subset(c, merged)) {
+            dominated = true;
+            break;
+          }
+        }
+        if (dominated) continue;
+        res.erase(std::remove_if(res.begin(), res.end(), [&merged](const InlineCut& c) {
+          return cut_subset(merged, c);
+        }), res.end());
+        res.push_back(merged);
+      }
+    }
+    std::sort(res.begin(), res.end(), cut_less);
+    if (max_cuts > 0 && static_cast<int>(res.size()) > max_cuts) res.resize(max_cuts);
+  }
+
+  void enumerate_cuts(const aigman& aig, int max_cut_size, int max_cuts_per_node, int num_threads, CutSet& out) {
+    AigSnapshot snapshot;
+    build_aig_snapshot(aig, num_threads, snapshot);
+    enumerate_cuts(snapshot, max_cut_size, max_cuts_per_node, num_threads, out);
+  }
+
+  void enumerate_cuts(const AigSnapshot& aig, int max_cut_size, int max_cuts_per_node, int num_threads, CutSet& out) {
+    assert(!aig.levels.empty());
+    assert(max_cut_size >= 1 && max_cut_size <= InlineCut::MAX_LEAVES);
+    out.cuts.clear();
+    out.first.assign(aig.num_objs, 0);
+    out.count.assign(aig.num_objs, 0);
+    // Constant node: the empty cut
+    out.cuts.push_back(InlineCut());
+    out.count[0] = 1;
+    for (int i = 1; i <= aig.num_pis; i++) {
+      out.first[i] = static_cast<uint32_t>(out.cuts.size());
+      out.count[i] = 1;
+      out.cuts.push_back(trivial_cut(i));
+    }
+
+    // Bucket gates by level; a level only reads cuts of lower levels. Dead
+    // nodes have no fanins and get no cuts.
+    const std::vector<int>& levels = aig.levels;
+    int max_level = 0;
+    for (int node = aig.num_pis + 1; node < aig.num_objs; node++) {
+      if (aig.is_gate(node)) max_level = std::max(max_level, levels[node]);
+    }
+    std::vector<std::vector<int>> by_level(max_level + 1);
+    for (int node = aig.num_pis + 1; node < aig.num_objs; node++) {
+      if (aig.is_gate(node)) by_level[levels[node]].push_back(node);
+    }
+
+    int threads = std::max(1, num_threads);
+    std::vector<std::vector<InlineCut>> thread_cuts(threads);
+    std::vector<std::vector<InlineCut>> scratch(threads);
+    std::vector<uint32_t> local_first(aig.num_objs, 0);  // offset in the owner's buffer
+    std::vector<int> owner(aig.num_objs, 0);
+    for (const auto& nodes : by_level) {
+      for (auto& v : thread_cuts) v.clear();
+      parallel_for_chunks(0, static_cast<int>(nodes.size()), threads, 64, [&](int b, int e, int t) {
+        auto& buf = thread_cuts[t];
+        auto& res = scratch[t];
+        for (int i = b; i < e; i++) {
+          int node = nodes[i];
+          node_cuts(aig, out, node, max_cut_size, max_cuts_per_node, res);
+          local_first[node] = static_cast<uint32_t>(buf.size());
+          owner[node] = t;
+          out.count[node] = static_cast<uint32_t>(res.size() + 1);
+          buf.push_back(trivial_cut(node));
+          buf.insert(buf.end(), res.begin(), res.end());
+        }
+      });
+      // Append per-thread results in thread order; buffers of unused threads are empty
+      std::vector<uint32_t> thread_base(threads);
+      for (int t = 0; t < threads; t++) {
+        thread_base[t] = static_cast<uint32_t>(out.cuts.size());
+        out.cuts.insert(out.cuts.end(), thread_cuts[t].begin(), thread_cuts[t].end());
+      }
+      for (int node : nodes) out.first[node] = thread_base[owner[node]] + local_first[node];
+    }
+  }
+
+} // namespace fresub
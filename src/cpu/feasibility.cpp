@@ -1,19 +1,23 @@
 #include "feasibility.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <cassert>
+#include <queue>
+#include <tuple>
 
 namespace fresub {
 
   // Multi-word implementation of gresub feasibility check - returns true if feasible
-  bool solve_resub_overlap_multiword(int i, int j, int k, int l, const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs) {
+  bool solve_resub_overlap_multiword(int i, int j, int k, int l, const TruthTables& truth_tables, int num_inputs, const uint64_t* care) {
     int num_patterns = 1 << num_inputs;
     int num_words = (num_patterns + 63) / 64;
     // Process all words using bitwise operations
     uint64_t qs[32] = {0};
     for (int word_idx = 0; word_idx < num_words; word_idx++) {
-      uint64_t t_on = truth_tables.back()[word_idx];
-      uint64_t t_off = ~t_on;
+      uint64_t c = care ? care[word_idx] : ~0ull;
+      uint64_t t_on = truth_tables.back()[word_idx] & c;
+      uint64_t t_off = ~truth_tables.back()[word_idx] & c;
       uint64_t t_i = truth_tables[i][word_idx];
       uint64_t t_j = truth_tables[j][word_idx];
       uint64_t t_k = truth_tables[k][word_idx];
@@ -62,7 +66,7 @@ namespace fresub {
   }
 
   // --- Skeletons for 0..3-input overlap feasibility (to be implemented) ---
-  bool solve_resub_overlap_multiword_0(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs) {
+  bool solve_resub_overlap_multiword_0(const TruthTables& truth_tables, int num_inputs, const uint64_t* care) {
     if (truth_tables.empty()) return false;
     const auto& target = truth_tables.back();
     int num_patterns = 1 << num_inputs;
@@ -71,22 +75,24 @@ namespace fresub {
     bool all_zero = true;
     bool all_one = true;
     for (int word_idx = 0; word_idx < num_words; word_idx++) {
+      uint64_t c = care ? care[word_idx] : ~0ull;
       uint64_t t = target[word_idx];
-      if (t) all_zero = false;     // some 1s present -> not all zero
-      if (~t) all_one = false;     // some 0s present -> not all ones
+      if (t & c) all_zero = false;     // some 1s present -> not all zero
+      if (~t & c) all_one = false;     // some 0s present -> not all ones
       if (!all_zero && !all_one) break; // early exit
     }
     return all_zero || all_one;
   }
 
-  bool solve_resub_overlap_multiword_1(int i, const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs) {
+  bool solve_resub_overlap_multiword_1(int i, const TruthTables& truth_tables, int num_inputs, const uint64_t* care) {
     // Accumulate conflicts per divisor pattern using the same style as 4-input version
     int num_patterns = 1 << num_inputs;
     int num_words = (num_patterns + 63) / 64;
     uint64_t qs[4] = {0};
     for (int word_idx = 0; word_idx < num_words; word_idx++) {
-      uint64_t t_on = truth_tables.back()[word_idx];
-      uint64_t t_off = ~t_on;
+      uint64_t c = care ? care[word_idx] : ~0ull;
+      uint64_t t_on = truth_tables.back()[word_idx] & c;
+      uint64_t t_off = ~truth_tables.back()[word_idx] & c;
       uint64_t t_i = truth_tables[i][word_idx];
       qs[0] |= t_off &  t_i; // pattern: i=1, target=0
       qs[1] |= t_on  &  t_i; // pattern: i=1, target=1
@@ -102,16 +108,18 @@ namespace fresub {
     return r;
   }
 
-  bool solve_resub_overlap_multiword_2(int i, int j, const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs) {
+  // 2-divisor check over raw rows, shared with the virtual divisors of
+  // find_feasible_double_divisor_resub, which are not interned
+  static bool overlap_rows_2(const uint64_t* row_i, const uint64_t* row_j, const uint64_t* target, int num_words,
+                             const uint64_t* care) {
     // Mirror 4-input style with 2 divisors => 4 patterns (00,01,10,11), each with onset/offset
-    int num_patterns = 1 << num_inputs;
-    int num_words = (num_patterns + 63) / 64;
     uint64_t qs[8] = {0};
     for (int word_idx = 0; word_idx < num_words; word_idx++) {
-      uint64_t t_on = truth_tables.back()[word_idx];
-      uint64_t t_off = ~t_on;
-      uint64_t t_i = truth_tables[i][word_idx];
-      uint64_t t_j = truth_tables[j][word_idx];
+      uint64_t c = care ? care[word_idx] : ~0ull;
+      uint64_t t_on = target[word_idx] & c;
+      uint64_t t_off = ~target[word_idx] & c;
+      uint64_t t_i = row_i[word_idx];
+      uint64_t t_j = row_j[word_idx];
       // pattern 11
       qs[0] |= t_off &  t_i &  t_j;
       qs[1] |= t_on  &  t_i &  t_j;
@@ -134,14 +142,21 @@ namespace fresub {
     return r;
   }
 
-  bool solve_resub_overlap_multiword_3(int i, int j, int k, const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs) {
+  bool solve_resub_overlap_multiword_2(int i, int j, const TruthTables& truth_tables, int num_inputs, const uint64_t* care) {
+    int num_patterns = 1 << num_inputs;
+    int num_words = (num_patterns + 63) / 64;
+    return overlap_rows_2(truth_tables[i].data(), truth_tables[j].data(), truth_tables.back().data(), num_words, care);
+  }
+
+  bool solve_resub_overlap_multiword_3(int i, int j, int k, const TruthTables& truth_tables, int num_inputs, const uint64_t* care) {
     // Mirror 4-input style with 3 divisors => 8 patterns, each with onset/offset
     int num_patterns = 1 << num_inputs;
     int num_words = (num_patterns + 63) / 64;
     uint64_t qs[16] = {0};
     for (int word_idx = 0; word_idx < num_words; word_idx++) {
-      uint64_t t_on = truth_tables.back()[word_idx];
-      uint64_t t_off = ~t_on;
+      uint64_t c = care ? care[word_idx] : ~0ull;
+      uint64_t t_on = truth_tables.back()[word_idx] & c;
+      uint64_t t_off = ~truth_tables.back()[word_idx] & c;
       uint64_t t_i = truth_tables[i][word_idx];
       uint64_t t_j = truth_tables[j][word_idx];
       uint64_t t_k = truth_tables[k][word_idx];
@@ -179,73 +194,154 @@ namespace fresub {
     return r;
   }
 
-  // Find all feasible 4-input resubstitution combinations (populate FeasibleSet list)
-  void find_feasible_4resub(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets) {
-    if (truth_tables.size() < 5) {
-      return; // Need at least 4 divisors
-    }
-    int n_divisors = static_cast<int>(truth_tables.size()) - 1;
-    for (int i = 0; i < n_divisors; i++) {
-      for (int j = i + 1; j < n_divisors; j++) {
-        for (int k = j + 1; k < n_divisors; k++) {
-          for (int l = k + 1; l < n_divisors; l++) {
-            if (solve_resub_overlap_multiword(i, j, k, l, truth_tables, num_inputs)) {
-              FeasibleSet fs;
-              fs.divisor_indices = {i, j, k, l};
-              out_sets.push_back(std::move(fs));
-            }
-          }
-        }
-      }
-    }
-  }
-
-  // --- Skeletons for k=0..3 enumerators (to be implemented) ---
-  void find_feasible_0resub(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets) {
-    if (solve_resub_overlap_multiword_0(truth_tables, num_inputs)) {
-      FeasibleSet fs;
-      fs.divisor_indices = {};
-      out_sets.push_back(std::move(fs));
+  // Feasibility of one sorted k-combination (k = 0..4)
+  static bool solve_combination(const int* c, int k, const TruthTables& truth_tables, int num_inputs, const uint64_t* care) {
+    switch (k) {
+    case 0: return solve_resub_overlap_multiword_0(truth_tables, num_inputs, care);
+    case 1: return solve_resub_overlap_multiword_1(c[0], truth_tables, num_inputs, care);
+    case 2: return solve_resub_overlap_multiword_2(c[0], c[1], truth_tables, num_inputs, care);
+    case 3: return solve_resub_overlap_multiword_3(c[0], c[1], c[2], truth_tables, num_inputs, care);
+    default: return solve_resub_overlap_multiword(c[0], c[1], c[2], c[3], truth_tables, num_inputs, care);
     }
   }
 
-  void find_feasible_1resub(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets) {
+  int enumerate_feasible(const TruthTables& truth_tables, int num_inputs, int k, const FeasibleVisitor& visit, const std::vector<int>* order, const uint64_t* care) {
     int n_divisors = static_cast<int>(truth_tables.size()) - 1;
-    for (int i = 0; i < n_divisors; i++) {
-      if (solve_resub_overlap_multiword_1(i, truth_tables, num_inputs)) {
-        FeasibleSet fs;
-        fs.divisor_indices = {i};
-        out_sets.push_back(std::move(fs));
+    if (k < 0 || k > 4 || n_divisors < k) {
+      return 0;
+    }
+    assert(n_divisors <= UINT16_MAX);
+    assert(!order || static_cast<int>(order->size()) == n_divisors);
+    int c[4] = {0, 1, 2, 3};
+    int d[4];
+    int accepted = 0;
+    while (true) {
+      const int* divs = c;
+      if (order) {
+        for (int i = 0; i < k; i++) d[i] = (*order)[c[i]];
+        std::sort(d, d + k);
+        divs = d;
+      }
+      if (solve_combination(divs, k, truth_tables, num_inputs, care)) {
+        DivisorIndices combination;
+        for (int i = 0; i < k; i++) combination.push_back(divs[i]);
+        FeasibleVisit action = visit(combination);
+        if (action != FeasibleVisit::REJECT) accepted++;
+        if (action == FeasibleVisit::STOP) break;
       }
+      // Advance to the next combination in lexicographic order
+      int i = k - 1;
+      while (i >= 0 && c[i] == n_divisors - k + i) i--;
+      if (i < 0) break;
+      c[i]++;
+      for (int j = i + 1; j < k; j++) c[j] = c[j - 1] + 1;
     }
+    return accepted;
   }
 
-  void find_feasible_2resub(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets) {
+  std::vector<int> order_divisors_by_distinguishing_power(const TruthTables& truth_tables, int num_inputs, const uint64_t* care) {
     int n_divisors = static_cast<int>(truth_tables.size()) - 1;
+    int num_patterns = 1 << num_inputs;
+    int num_words = (num_patterns + 63) / 64;
+    uint64_t mask = num_patterns < 64 ? (1ull << num_patterns) - 1 : ~0ull;
+    const auto& target = truth_tables.back();
+    std::vector<uint64_t> power(n_divisors);
     for (int i = 0; i < n_divisors; i++) {
-      for (int j = i + 1; j < n_divisors; j++) {
-        if (solve_resub_overlap_multiword_2(i, j, truth_tables, num_inputs)) {
-          FeasibleSet fs;
-          fs.divisor_indices = {i, j};
-          out_sets.push_back(std::move(fs));
-        }
+      uint64_t on1 = 0, on0 = 0, off1 = 0, off0 = 0;
+      for (int w = 0; w < num_words; w++) {
+        uint64_t c = (care ? care[w] : ~0ull) & mask;
+        uint64_t t = target[w] & c;
+        uint64_t t_off = ~target[w] & c;
+        uint64_t d = truth_tables[i][w];
+        on1 += __builtin_popcountll(t & d);
+        on0 += __builtin_popcountll(t & ~d);
+        off1 += __builtin_popcountll(t_off & d);
+        off0 += __builtin_popcountll(t_off & ~d);
       }
+      power[i] = on1 * off0 + on0 * off1;
     }
+    std::vector<int> order(n_divisors);
+    for (int i = 0; i < n_divisors; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&power](int a, int b) { return power[a] > power[b]; });
+    return order;
   }
 
-  void find_feasible_3resub(const std::vector<std::vector<uint64_t>>& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets) {
-    int n_divisors = static_cast<int>(truth_tables.size()) - 1;
-    for (int i = 0; i < n_divisors; i++) {
-      for (int j = i + 1; j < n_divisors; j++) {
-        for (int k = j + 1; k < n_divisors; k++) {
-          if (solve_resub_overlap_multiword_3(i, j, k, truth_tables, num_inputs)) {
-            FeasibleSet fs;
-            fs.divisor_indices = {i, j, k};
-            out_sets.push_back(std::move(fs));
-          }
-        }
+  // Visitor appending every combination to a FeasibleSet list
+  static FeasibleVisitor collect_into(std::vector<FeasibleSet>& out_sets) {
+    return [&out_sets](const DivisorIndices& combination) {
+      FeasibleSet fs;
+      fs.divisor_indices = combination;
+      out_sets.push_back(fs);
+      return FeasibleVisit::ACCEPT;
+    };
+  }
+
+  // Find all feasible 4-input resubstitution combinations (populate FeasibleSet list)
+  void find_feasible_4resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care) {
+    enumerate_feasible(truth_tables, num_inputs, 4, collect_into(out_sets), nullptr, care);
+  }
+
+  void find_feasible_0resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care) {
+    enumerate_feasible(truth_tables, num_inputs, 0, collect_into(out_sets), nullptr, care);
+  }
+
+  void find_feasible_1resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care) {
+    enumerate_feasible(truth_tables, num_inputs, 1, collect_into(out_sets), nullptr, care);
+  }
+
+  void find_feasible_2resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care) {
+    enumerate_feasible(truth_tables, num_inputs, 2, collect_into(out_sets), nullptr, care);
+  }
+
+  void find_feasible_3resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care) {
+    enumerate_feasible(truth_tables, num_inputs, 3, collect_into(out_sets), nullptr, care);
+  }
+
+  int find_feasible_first_n(const TruthTables& truth_tables, int num_inputs, int k, int n, std::vector<FeasibleSet>& out_sets, const uint64_t* care) {
+    if (n <= 0) return 0;
+    int found = 0;
+    return enumerate_feasible(truth_tables, num_inputs, k, [&](const DivisorIndices& combination) {
+      FeasibleSet fs;
+      fs.divisor_indices = combination;
+      out_sets.push_back(fs);
+      return ++found == n ? FeasibleVisit::STOP : FeasibleVisit::ACCEPT;
+    }, nullptr, care);
+  }
+
+  int find_feasible_best_n(const TruthTables& truth_tables, int num_inputs, int k, int n, const FeasibleCost& cost, std::vector<FeasibleSet>& out_sets, const uint64_t* care) {
+    if (n <= 0) return 0;
+    // Max-heap on (cost, sequence): the top is the worst kept combination
+    using Entry = std::tuple<int, int, DivisorIndices>;
+    auto worse = [](const Entry& a, const Entry& b) {
+      return std::tie(std::get<0>(a), std::get<1>(a)) < std::tie(std::get<0>(b), std::get<1>(b));
+    };
+    std::priority_queue<Entry, std::vector<Entry>, decltype(worse)> heap(worse);
+    int seq = 0;
+    enumerate_feasible(truth_tables, num_inputs, k, [&](const DivisorIndices& combination) {
+      Entry entry(cost(combination), seq++, combination);
+      if (static_cast<int>(heap.size()) < n) {
+        heap.push(entry);
+      } else if (worse(entry, heap.top())) {
+        heap.pop();
+        heap.push(entry);
+      } else {
+        return FeasibleVisit::REJECT;
       }
+      return FeasibleVisit::ACCEPT;
+    }, nullptr, care);
+    int kept = static_cast<int>(heap.size());
+    size_t base = out_sets.size();
+    out_sets.resize(base + kept);
+    for (int i = kept - 1; i >= 0; i--) {
+      out_sets[base + i].divisor_indices = std::get<2>(heap.top());
+      heap.pop();
     }
+    return kept;
+  }
+
+  // ODC care mask of a window for the kernels (nullptr = all patterns care)
+  static const uint64_t* window_care(const Window& window) {
+    return window.care.empty() ? nullptr : window.care.data();
   }
 
   // --- Skeletons for CPU feasibility modes (to be implemented) ---
@@ -253,14 +349,57 @@ namespace fresub {
     while (it != end) {
       const auto& tts = it->truth_tables;
       int num_inputs = static_cast<int>(it->inputs.size());
+      const uint64_t* care = window_care(*it);
       int n_div = static_cast<int>(tts.size()) - 1;
       int k = std::min(4, n_div);
       assert(it->feasible_sets.empty());
-      if (k == 0)        find_feasible_0resub(tts, num_inputs, it->feasible_sets);
-      else if (k == 1)   find_feasible_1resub(tts, num_inputs, it->feasible_sets);
-      else if (k == 2)   find_feasible_2resub(tts, num_inputs, it->feasible_sets);
-      else if (k == 3)   find_feasible_3resub(tts, num_inputs, it->feasible_sets);
-      else /* k == 4 */  find_feasible_4resub(tts, num_inputs, it->feasible_sets);
+      if (k == 0)        find_feasible_0resub(tts, num_inputs, it->feasible_sets, care);
+      else if (k == 1)   find_feasible_1resub(tts, num_inputs, it->feasible_sets, care);
+      else if (k == 2)   find_feasible_2resub(tts, num_inputs, it->feasible_sets, care);
+      else if (k == 3)   find_feasible_3resub(tts, num_inputs, it->feasible_sets, care);
+      else /* k == 4 */  find_feasible_4resub(tts, num_inputs, it->feasible_sets, care);
+      for (auto& fs : it->feasible_sets) fs.window_id = it->cut_id;
+      ++it;
+    }
+  }
+
+  void feasibility_check_cpu_all_top(std::vector<Window>::iterator it, std::vector<Window>::iterator end, int max_sets, const std::vector<int>& levels) {
+    while (it != end) {
+      const auto& tts = it->truth_tables;
+      int num_inputs = static_cast<int>(it->inputs.size());
+      const uint64_t* care = window_care(*it);
+      int n_div = static_cast<int>(tts.size()) - 1;
+      int k = std::min(4, n_div);
+      assert(it->feasible_sets.empty());
+      const auto& divisors = it->divisors;
+      find_feasible_best_n(tts, num_inputs, k, max_sets, [&](const DivisorIndices& combination) {
+        int sum = 0;
+        for (int idx : combination) sum += levels[divisors[idx]];
+        return sum;
+      }, it->feasible_sets, care);
+      for (auto& fs : it->feasible_sets) fs.window_id = it->cut_id;
+      ++it;
+    }
+  }
+
+  void feasibility_check_cpu_first(std::vector<Window>::iterator it, std::vector<Window>::iterator end) {
+    while (it != end) {
+      const auto& tts = it->truth_tables;
+      int num_inputs = static_cast<int>(it->inputs.size());
+      const uint64_t* care = window_care(*it);
+      int n_div = static_cast<int>(tts.size()) - 1;
+      assert(it->feasible_sets.empty());
+      std::vector<int> order = order_divisors_by_distinguishing_power(tts, num_inputs, care);
+      auto& out = it->feasible_sets;
+      for (int k = 0; k <= std::min(4, n_div) && out.empty(); k++) {
+        enumerate_feasible(tts, num_inputs, k, [&out](const DivisorIndices& combination) {
+          FeasibleSet fs;
+          fs.divisor_indices = combination;
+          out.push_back(fs);
+          return FeasibleVisit::STOP;
+        }, &order, care);
+      }
+      for (auto& fs : out) fs.window_id = it->cut_id;
       ++it;
     }
   }
@@ -269,17 +408,307 @@ namespace fresub {
     while (it != end) {
       const auto& tts = it->truth_tables;
       int num_inputs = static_cast<int>(it->inputs.size());
+      const uint64_t* care = window_care(*it);
       int n_div = static_cast<int>(tts.size()) - 1;
       assert(it->feasible_sets.empty());
       // Try increasing k until first non-empty
-      find_feasible_0resub(tts, num_inputs, it->feasible_sets);
-      if (it->feasible_sets.empty() && n_div >= 1) find_feasible_1resub(tts, num_inputs, it->feasible_sets);
-      if (it->feasible_sets.empty() && n_div >= 2) find_feasible_2resub(tts, num_inputs, it->feasible_sets);
-      if (it->feasible_sets.empty() && n_div >= 3) find_feasible_3resub(tts, num_inputs, it->feasible_sets);
-      if (it->feasible_sets.empty() && n_div >= 4) find_feasible_4resub(tts, num_inputs, it->feasible_sets);
+      find_feasible_0resub(tts, num_inputs, it->feasible_sets, care);
+      if (it->feasible_sets.empty() && n_div >= 1) find_feasible_1resub(tts, num_inputs, it->feasible_sets, care);
+      if (it->feasible_sets.empty() && n_div >= 2) find_feasible_2resub(tts, num_inputs, it->feasible_sets, care);
+      if (it->feasible_sets.empty() && n_div >= 3) find_feasible_3resub(tts, num_inputs, it->feasible_sets, care);
+      if (it->feasible_sets.empty() && n_div >= 4) find_feasible_4resub(tts, num_inputs, it->feasible_sets, care);
+      for (auto& fs : it->feasible_sets) fs.window_id = it->cut_id;
+
+      ++it;
+    }
+  }
+
+  // Virtual divisor AND(d_a ^ ca, d_b ^ cb) over real divisors a < b
+  struct VirtualDivisor {
+    int a, b;
+    bool ca, cb;
+  };
+
+  // 3-gate structure out = AND(v1 ^ x1, v2 ^ x2) ^ z over divisor_indices order
+  static aigman* build_double_divisor_circuit(const DivisorIndices& indices, const VirtualDivisor& v1, const VirtualDivisor& v2, bool x1, bool x2, bool z) {
+    auto lit = [&indices](int divisor, bool compl_) {
+      int pos = static_cast<int>(std::find(indices.begin(), indices.end(), divisor) - indices.begin());
+      return 2 * (pos + 1) + (compl_ ? 1 : 0);
+    };
+    aigman* aig = new aigman(4, 1);
+    int g1 = aig->newgate(lit(v1.a, v1.ca), lit(v1.b, v1.cb));
+    int g2 = aig->newgate(lit(v2.a, v2.ca), lit(v2.b, v2.cb));
+    int g3 = aig->newgate(2 * g1 + (x1 ? 1 : 0), 2 * g2 + (x2 ? 1 : 0));
+    aig->vPos[0] = 2 * g3 + (z ? 1 : 0);
+    return aig;
+  }
+
+  int find_feasible_double_divisor_resub(const TruthTables& truth_tables, int num_inputs, std::vector<FeasibleSet>& out_sets, const uint64_t* care) {
+    int n_div = static_cast<int>(truth_tables.size()) - 1;
+    int num_words = ((1 << num_inputs) + 63) / 64;
+    const auto& target = truth_tables.back();
+    // Virtual divisors that are unate w.r.t. the target: the only ones usable
+    // as an input of a single AND/OR producing it
+    // Their truth tables are scratch, kept flat (num_words per virtual divisor)
+    // rather than interned in the shared store
+    std::vector<VirtualDivisor> virtuals;
+    std::vector<uint64_t> vtts;
+    std::vector<uint64_t> tt(num_words);
+    for (int a = 0; a < n_div; a++) {
+      for (int b = a + 1; b < n_div; b++) {
+        for (int phase = 0; phase < 4; phase++) {
+          bool ca = phase & 1, cb = phase & 2;
+          uint64_t hit[4] = {0, 0, 0, 0};  // v & on, v & off, ~v & on, ~v & off
+          for (int w = 0; w < num_words; w++) {
+            uint64_t c = care ? care[w] : ~0ull;
+            uint64_t on = target[w] & c, off = ~target[w] & c;
+            uint64_t da = truth_tables[a][w] ^ (ca ? ~0ull : 0);
+            uint64_t db = truth_tables[b][w] ^ (cb ? ~0ull : 0);
+            tt[w] = da & db;
+            hit[0] |= tt[w] & on;
+            hit[1] |= tt[w] & off;
+            hit[2] |= ~tt[w] & on;
+            hit[3] |= ~tt[w] & off;
+          }
+          if (hit[0] && hit[1] && hit[2] && hit[3]) continue;
+          virtuals.push_back({a, b, ca, cb});
+          vtts.insert(vtts.end(), tt.begin(), tt.end());
+        }
+      }
+    }
+    int n_virtual = static_cast<int>(virtuals.size());
+    // 2-resub over virtual pairs on four distinct real divisors (pairs sharing
+    // a divisor are 3-resub, already infeasible when this runs)
+    std::vector<FeasibleSet> found;
+    for (int i = 0; i < n_virtual; i++) {
+      const VirtualDivisor& v1 = virtuals[i];
+      for (int j = i + 1; j < n_virtual; j++) {
+        const VirtualDivisor& v2 = virtuals[j];
+        if (v1.a == v2.a || v1.a == v2.b || v1.b == v2.a || v1.b == v2.b) continue;
+        const uint64_t* vi = vtts.data() + static_cast<size_t>(i) * num_words;
+        const uint64_t* vj = vtts.data() + static_cast<size_t>(j) * num_words;
+        if (!overlap_rows_2(vi, vj, target.data(), num_words, care)) continue;
+        // Onset/offset occupancy per (v1, v2) pattern, as in the kernel
+        bool has_on[4] = {false, false, false, false}, has_off[4] = {false, false, false, false};
+        for (int w = 0; w < num_words; w++) {
+          uint64_t c = care ? care[w] : ~0ull;
+          uint64_t on = target[w] & c, off = ~target[w] & c;
+          for (int h = 0; h < 4; h++) {
+            uint64_t m = ((h & 1) ? vi[w] : ~vi[w]) & ((h & 2) ? vj[w] : ~vj[w]);
+            has_on[h] |= (m & on) != 0;
+            has_off[h] |= (m & off) != 0;
+          }
+        }
+        // One gate suffices if a single pattern holds the whole onset (AND)
+        // or the whole offset (NAND); XOR-like matches are left to 4-resub
+        for (int h = 0; h < 4; h++) {
+          bool and_form = true, nand_form = true;
+          for (int g = 0; g < 4; g++) {
+            if (g == h) continue;
+            and_form &= !has_on[g];
+            nand_form &= !has_off[g];
+          }
+          if (!and_form && !nand_form) continue;
+          std::vector<int> divisors = {v1.a, v1.b, v2.a, v2.b};
+          std::sort(divisors.begin(), divisors.end());
+          FeasibleSet fs;
+          for (int d : divisors) fs.divisor_indices.push_back(d);
+          fs.synth = build_double_divisor_circuit(fs.divisor_indices, v1, v2, !(h & 1), !(h & 2), !and_form);
+          found.push_back(fs);
+          break;
+        }
+      }
+    }
+    // One structure per divisor combination, in lexicographic order
+    std::stable_sort(found.begin(), found.end(), [](const FeasibleSet& x, const FeasibleSet& y) {
+      return std::lexicographical_compare(x.divisor_indices.begin(), x.divisor_indices.end(),
+                                          y.divisor_indices.begin(), y.divisor_indices.end());
+    });
+    int count = 0;
+    for (size_t i = 0; i < found.size(); i++) {
+      if (i > 0 && std::equal(found[i].divisor_indices.begin(), found[i].divisor_indices.end(),
+                              found[i - 1].divisor_indices.begin(), found[i - 1].divisor_indices.end())) {
+        delete found[i].synth;
+        continue;
+      }
+      out_sets.push_back(found[i]);
+      count++;
+    }
+    return count;
+  }
+
+  void feasibility_check_cpu_min_virtual(std::vector<Window>::iterator it, std::vector<Window>::iterator end) {
+    while (it != end) {
+      const auto& tts = it->truth_tables;
+      int num_inputs = static_cast<int>(it->inputs.size());
+      const uint64_t* care = window_care(*it);
+      int n_div = static_cast<int>(tts.size()) - 1;
+      assert(it->feasible_sets.empty());
+      find_feasible_0resub(tts, num_inputs, it->feasible_sets, care);
+      if (it->feasible_sets.empty() && n_div >= 1) find_feasible_1resub(tts, num_inputs, it->feasible_sets, care);
+      if (it->feasible_sets.empty() && n_div >= 2) find_feasible_2resub(tts, num_inputs, it->feasible_sets, care);
+      if (it->feasible_sets.empty() && n_div >= 3) find_feasible_3resub(tts, num_inputs, it->feasible_sets, care);
+      // Double divisors only pay off when the 3-gate structure is a gain
+      if (it->feasible_sets.empty() && n_div >= 4 && it->mffc_size > 3) find_feasible_double_divisor_resub(tts, num_inputs, it->feasible_sets, care);
+      if (it->feasible_sets.empty() && n_div >= 4) find_feasible_4resub(tts, num_inputs, it->feasible_sets, care);
+      for (auto& fs : it->feasible_sets) fs.window_id = it->cut_id;
 
       ++it;
     }
   }
 
+  uint64_t combination_count(int n, int k) {
+    if (k < 0 || n < k) return 0;
+    uint64_t r = 1;
+    for (int i = 1; i <= k; i++) {
+      r = r * (n - k + i) / i;
+    }
+    return r;
+  }
+
+  uint64_t combination_rank(const DivisorIndices& combination) {
+    uint64_t rank = 0;
+    for (size_t i = 0; i < combination.size(); i++) {
+      assert(i == 0 || combination[i - 1] < combination[i]);
+      rank += combination_count(combination[i], static_cast<int>(i) + 1);
+    }
+    return rank;
+  }
+
+  DivisorIndices combination_unrank(uint64_t rank, int k) {
+    int idx[4] = {0, 0, 0, 0};
+    for (int i = k - 1; i >= 0; i--) {
+      // Largest c with C(c, i+1) <= rank
+      int c = i;
+      while (combination_count(c + 1, i + 1) <= rank) c++;
+      idx[i] = c;
+      rank -= combination_count(c, i + 1);
+    }
+    DivisorIndices combination;
+    for (int i = 0; i < k; i++) combination.push_back(idx[i]);
+    return combination;
+  }
+
+  void feasibility_check_cpu_all_bitmap(std::vector<Window>::iterator it, std::vector<Window>::iterator end) {
+    while (it != end) {
+      const auto& tts = it->truth_tables;
+      int num_inputs = static_cast<int>(it->inputs.size());
+      const uint64_t* care = window_care(*it);
+      int n_div = static_cast<int>(tts.size()) - 1;
+      int k = std::min(4, n_div);
+      uint64_t num_combinations = combination_count(n_div, k);
+      it->feasible_k = k;
+      it->feasible_bitmap.assign((num_combinations + 63) / 64, 0);
+      auto& bitmap = it->feasible_bitmap;
+      enumerate_feasible(tts, num_inputs, k, [&bitmap](const DivisorIndices& combination) {
+        uint64_t r = combination_rank(combination);
+        bitmap[r >> 6] |= 1ull << (r & 63);
+        return FeasibleVisit::ACCEPT;
+      }, nullptr, care);
+      ++it;
+    }
+  }
+
+  void expand_feasible_bitmap(Window& window) {
+    for (size_t w = 0; w < window.feasible_bitmap.size(); w++) {
+      for (uint64_t bits = window.feasible_bitmap[w]; bits; bits &= bits - 1) {
+        uint64_t rank = w * 64 + __builtin_ctzll(bits);
+        FeasibleSet fs;
+        fs.divisor_indices = combination_unrank(rank, window.feasible_k);
+        fs.window_id = window.cut_id;
+        window.feasible_sets.push_back(fs);
+      }
+    }
+    window.feasible_bitmap.clear();
+    window.feasible_bitmap.shrink_to_fit();
+  }
+
+  // Canonical form of a window's function: key = (#inputs, #divisors, target,
+  // care mask, divisor tables sorted); perm[p] = original index of canonical position p
+  static void canonicalize(const Window& window, std::vector<uint64_t>& key, std::vector<int>& perm) {
+    const auto& tts = window.truth_tables;
+    int n_divisors = static_cast<int>(tts.size()) - 1;
+    perm.resize(n_divisors);
+    for (int i = 0; i < n_divisors; i++) perm[i] = i;
+    std::stable_sort(perm.begin(), perm.end(), [&tts](int a, int b) { return tts[a] < tts[b]; });
+    key.clear();
+    key.push_back(window.inputs.size());
+    key.push_back(n_divisors);
+    key.push_back(window.care.size());
+    key.insert(key.end(), tts.back().begin(), tts.back().end());
+    key.insert(key.end(), window.care.begin(), window.care.end());
+    for (int p : perm) key.insert(key.end(), tts[p].begin(), tts[p].end());
+  }
+
+  static uint64_t hash_key(const std::vector<uint64_t>& key) {
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    for (uint64_t word : key) {
+      h ^= word + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+      h *= 0xff51afd7ed558ccdull;
+    }
+    return h;
+  }
+
+  bool FeasibilityCache::lookup(Window& window) {
+    std::vector<uint64_t> key;
+    std::vector<int> perm;
+    canonicalize(window, key, perm);
+    auto bucket = table.find(hash_key(key));
+    if (bucket != table.end()) {
+      for (const auto& entry : bucket->second) {
+        if (entry.key != key) continue;
+        hits++;
+        window.feasible_sets.clear();
+        for (const auto& canonical : entry.sets) {
+          int divs[4];
+          int k = static_cast<int>(canonical.size());
+          for (int i = 0; i < k; i++) divs[i] = perm[canonical[i]];
+          std::sort(divs, divs + k);
+          FeasibleSet fs;
+          fs.window_id = window.cut_id;
+          for (int i = 0; i < k; i++) fs.divisor_indices.push_back(divs[i]);
+          window.feasible_sets.push_back(fs);
+        }
+        // Same order as a direct check (lexicographic within each size)
+        std::sort(window.feasible_sets.begin(), window.feasible_sets.end(), [](const FeasibleSet& a, const FeasibleSet& b) {
+          const auto& x = a.divisor_indices;
+          const auto& y = b.divisor_indices;
+          if (x.size() != y.size()) return x.size() < y.size();
+          return std::lexicographical_compare(x.begin(), x.end(), y.begin(), y.end());
+        });
+        return true;
+      }
+    }
+    misses++;
+    return false;
+  }
+
+  void FeasibilityCache::insert(const Window& window) {
+    std::vector<uint64_t> key;
+    std::vector<int> perm;
+    canonicalize(window, key, perm);
+    std::vector<int> position(perm.size());
+    for (size_t p = 0; p < perm.size(); p++) position[perm[p]] = static_cast<int>(p);
+    Entry entry;
+    for (const auto& fs : window.feasible_sets) {
+      int divs[4];
+      int k = static_cast<int>(fs.divisor_indices.size());
+      for (int i = 0; i < k; i++) divs[i] = position[fs.divisor_indices[i]];
+      std::sort(divs, divs + k);
+      DivisorIndices canonical;
+      for (int i = 0; i < k; i++) canonical.push_back(divs[i]);
+      entry.sets.push_back(canonical);
+    }
+    entry.key = std::move(key);
+    table[hash_key(entry.key)].push_back(std::move(entry));
+  }
+
+  void feasibility_check_cached(std::vector<Window>::iterator it, std::vector<Window>::iterator end, FeasibilityCache& cache, const FeasibilityCheck& check) {
+    for (; it != end; ++it) {
+      if (cache.lookup(*it)) continue;
+      check(it, it + 1);
+      cache.insert(*it);
+    }
+  }
+
 } // namespace fresub
@@ -1,9 +1,12 @@
 #include "insertion.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <cassert>
 #include <queue>
 #include "aig_utils.hpp"
+#include "journal.hpp"
+#include "parallel.hpp"
 
 namespace fresub {
 
@@ -14,7 +17,6 @@ namespace fresub {
     int gain;
     int window_idx;
     int fs_idx;
-    int synth_idx;
   };
 
   struct HeapCmp {
@@ -23,7 +25,294 @@ namespace fresub {
     }
   };
 
-  int inserter_process_windows_heap(aigman& aig, std::vector<Window>& windows, bool verbose) {
+  // An ODC candidate relies on its region (WindowSnapshot::ODC nodes, target
+  // included) being observed only through the window; prior insertions may
+  // have added fanouts to those nodes, e.g. by using them as divisors
+  static bool odc_region_intact(const aigman& aig, const Window& win) {
+    const auto& local = win.local;
+    for (size_t i = 0; i < local.flags.size(); i++) {
+      if (!(local.flags[i] & WindowSnapshot::ODC)) continue;
+      int node = win.nodes[i];
+      if (!is_node_accessible(aig, node)) return false;
+      for (int fo : aig.vvFanouts[node]) {
+        if (!std::binary_search(win.nodes.begin(), win.nodes.end(), fo)) return false;
+      }
+    }
+    return true;
+  }
+
+  // Insertion state shared by candidate evaluation and commit
+  struct InsertState {
+    // Nodes whose function changed under an applied ODC replacement; windows
+    // containing them were simulated against stale functions
+    std::vector<char> odc_changed;
+    bool any_odc_changed = false;
+    // Epoch-stamped dirty set: stamp[n] is the number of the last applied
+    // import that touched n (0 = untouched). An import whose gain differs from
+    // the prediction may have simplified beyond the stamped region, after
+    // which stamps are no longer trusted.
+    std::vector<int> stamp;
+    bool stamps_valid = true;
+    // Potentials strictly increase along edges, so a divisor with a lower
+    // potential than the target cannot be in its TFO
+    std::vector<int> potential;
+    bool potentials_valid = false;
+
+    // Undo log of a speculative batch (enabled by `undo`): previous potentials
+    // and newly set odc_changed entries
+    bool undo = false;
+    std::vector<std::pair<int, int>> potential_undo;
+    std::vector<int> odc_undo;
+
+    int in_place = 0;  // tiny replacements rewritten without aig.import
+    bool needs_import = false;  // a speculative replacement the journal cannot apply
+
+    bool dirty_since(int node, int epoch) const {
+      return !stamps_valid || (node < static_cast<int>(stamp.size()) && stamp[node] > epoch);
+    }
+  };
+
+  // Per-thread scratch buffers for evaluation
+  struct EvalScratch {
+    std::vector<int> deref;
+    std::vector<int> visited;
+    int visit_id = 0;
+  };
+
+  // Result of evaluating a candidate against the current AIG
+  struct Evaluation {
+    bool ok = false;
+    bool reused = false;            // gain taken from window analysis
+    int gain = 0;
+    std::vector<int> selected_nodes;
+    std::vector<int> mffc;          // nodes removed by the import
+  };
+
+  // Cheap checks against the current AIG: target and divisors alive, ODC
+  // assumptions intact. Fills selected_nodes.
+  static bool candidate_alive(const aigman& aig, const Window& win, const FeasibleSet& fs,
+                              const InsertState& state, std::vector<int>& selected_nodes) {
+    if (!is_node_accessible(aig, win.target_node)) return false;
+    if (state.any_odc_changed) {
+      for (size_t i = 0; i < win.nodes.size(); i++) {
+        int node = win.nodes[i];
+        bool is_input = !win.local.flags.empty() && (win.local.flags[i] & WindowSnapshot::INPUT);
+        if (!is_input && node < static_cast<int>(state.odc_changed.size()) && state.odc_changed[node]) return false;
+      }
+    }
+    if (!win.care.empty() && !odc_region_intact(aig, win)) return false;
+    selected_nodes.clear();
+    selected_nodes.reserve(fs.divisor_indices.size());
+    for (int idx : fs.divisor_indices) {
+      int node = win.divisors[idx];
+      if (!is_node_accessible(aig, node)) return false;
+      selected_nodes.push_back(node);
+    }
+    return true;
+  }
+
+  // Whether any selected divisor is in the TFO of the target. Read-only on the
+  // AIG, so it may run concurrently; potentials bound the search when valid.
+  static bool divisor_in_tfo(const aigman& aig, const InsertState& state, int target,
+                             const std::vector<int>& selected_nodes, EvalScratch& scratch) {
+    if (selected_nodes.empty()) return false;
+    int bound = 0;
+    if (state.potentials_valid) {
+      bool below = true;
+      for (int node : selected_nodes) {
+        below = below && state.potential[node] < state.potential[target];
+        bound = std::max(bound, state.potential[node]);
+      }
+      if (below) return false;
+    }
+    if (static_cast<int>(scratch.visited.size()) < aig.nObjs) scratch.visited.resize(aig.nObjs, 0);
+    int id = ++scratch.visit_id;
+    std::vector<int> stack = {target};
+    scratch.visited[target] = id;
+    while (!stack.empty()) {
+      int node = stack.back();
+      stack.pop_back();
+      if (std::find(selected_nodes.begin(), selected_nodes.end(), node) != selected_nodes.end()) return true;
+      for (int fo : aig.vvFanouts[node]) {
+        if (fo >= aig.nObjs || scratch.visited[fo] == id) continue;
+        if (state.potentials_valid && state.potential[fo] > bound) continue;
+        scratch.visited[fo] = id;
+        stack.push_back(fo);
+      }
+    }
+    return false;
+  }
+
+  // Whether an import after the given epoch touched an MFFC node or one of
+  // its fanins (whose lost fanouts grow the MFFC)
+  static bool mffc_node_dirty(const aigman& aig, int node, const InsertState& state, int epoch) {
+    return state.dirty_since(node, epoch) ||
+           state.dirty_since(aig.vObjs[node * 2] >> 1, epoch) ||
+           state.dirty_since(aig.vObjs[node * 2 + 1] >> 1, epoch);
+  }
+
+  // A candidate is clean if no import after the given epoch touched its
+  // target, selected divisors, MFFC or MFFC fanins
+  static bool candidate_clean(const aigman& aig, const Window& win, const std::vector<int>& selected_nodes,
+                              const InsertState& state, int epoch) {
+    const auto& local = win.local;
+    if (local.flags.size() != win.nodes.size()) return false;
+    if (state.dirty_since(win.target_node, epoch)) return false;
+    for (int node : selected_nodes) {
+      if (state.dirty_since(node, epoch)) return false;
+    }
+    for (size_t i = 0; i < win.nodes.size(); i++) {
+      if ((local.flags[i] & WindowSnapshot::MFFC) && mffc_node_dirty(aig, win.nodes[i], state, epoch)) return false;
+    }
+    for (int node : local.mffc_below) {
+      if (mffc_node_dirty(aig, node, state, epoch)) return false;
+    }
+    return true;
+  }
+
+  // Whether an import after the given epoch touched the evaluated region: the
+  // target, divisors, MFFC or MFFC fanins (whose lost fanouts grow the MFFC)
+  static bool evaluation_dirty(const aigman& aig, int target, const Evaluation& eval,
+                               const InsertState& state, int epoch) {
+    if (state.dirty_since(target, epoch)) return true;
+    for (int node : eval.selected_nodes) {
+      if (state.dirty_since(node, epoch)) return true;
+    }
+    for (int node : eval.mffc) {
+      if (mffc_node_dirty(aig, node, state, epoch)) return true;
+    }
+    return false;
+  }
+
+  // Re-evaluate the current gain and acyclicity of a candidate. Read-only on
+  // the AIG apart from per-thread scratch.
+  static void evaluate_candidate(aigman& aig, const Window& win, const FeasibleSet& fs, int heap_gain,
+                                 const InsertState& state, EvalScratch& scratch, Evaluation& eval) {
+    eval = Evaluation();
+    if (!candidate_alive(aig, win, fs, state, eval.selected_nodes)) return;
+    if (divisor_in_tfo(aig, state, win.target_node, eval.selected_nodes, scratch)) return;
+    // Recompute current MFFC-based gain for the target node unless nothing it
+    // depends on has changed since window analysis
+    if (candidate_clean(aig, win, eval.selected_nodes, state, 0)) {
+      eval.gain = heap_gain;
+      eval.reused = true;
+      for (size_t i = 0; i < win.nodes.size(); i++) {
+        if (win.local.flags[i] & WindowSnapshot::MFFC) eval.mffc.push_back(win.nodes[i]);
+      }
+      eval.mffc.insert(eval.mffc.end(), win.local.mffc_below.begin(), win.local.mffc_below.end());
+    } else {
+      // Exclude selected divisors by priming their deref counts
+      auto cone = compute_mffc_excluding_divisors(aig, win.target_node, scratch.deref, eval.selected_nodes);
+      eval.mffc.assign(cone.begin(), cone.end());
+      eval.gain = static_cast<int>(eval.mffc.size()) - fs.synth->nGates;
+    }
+    // No longer beneficial after prior insertions
+    eval.ok = eval.gain > 0;
+  }
+
+  // Raise potentials so they stay strictly increasing along every edge after
+  // the fanins of the given nodes changed
+  static void raise_potentials(const aigman& aig, InsertState& state, std::vector<int> nodes) {
+    auto& potential = state.potential;
+    while (!nodes.empty()) {
+      int node = nodes.back();
+      nodes.pop_back();
+      if (node >= aig.nObjs || !is_node_accessible(aig, node)) continue;
+      int p0 = potential[aig.vObjs[node * 2] >> 1];
+      int p1 = potential[aig.vObjs[node * 2 + 1] >> 1];
+      int p = std::max(p0, p1) + 1;
+      if (p <= potential[node]) continue;
+      if (state.undo) state.potential_undo.emplace_back(node, potential[node]);
+      potential[node] = p;
+      for (int fo : aig.vvFanouts[node]) nodes.push_back(fo);
+    }
+  }
+
+  // Import the candidate and update stamps, potentials and ODC staleness.
+  // Tiny replacements are rewritten in place through the journal; larger
+  // ones use aig.import unless the batch is speculative, in which case every
+  // replacement stays in the journal for rollback.
+  static int commit_candidate(aigman& aig, const Window& win, const FeasibleSet& fs,
+                              const Evaluation& eval, InsertState& state, int epoch,
+                              AigJournal& journal, bool speculative) {
+    // Stamp what the import touches: the target and its fanouts (rewired),
+    // the divisors (new fanouts), and the removed MFFC with its fanins
+    int objs_before = aig.nObjs;
+    std::vector<int> target_fanouts = aig.vvFanouts[win.target_node];
+    auto touch = [&](int node) { if (node < objs_before) state.stamp[node] = epoch; };
+    touch(win.target_node);
+    for (int node : eval.selected_nodes) touch(node);
+    for (int fo : target_fanouts) touch(fo);
+    for (int node : eval.mffc) {
+      touch(node);
+      touch(aig.vObjs[node * 2] >> 1);
+      touch(aig.vObjs[node * 2 + 1] >> 1);
+    }
+
+    // Import synthesized circuit to replace target. The journal refuses
+    // replacements that need simplification; a speculative pass then stops
+    // and the batch is replayed with aig.import.
+    int gates_before = aig.nGates;
+    TinyCircuit tiny;
+    int saved = -1;
+    if (TinyCircuit::from_aig(*fs.synth, tiny)) {
+      saved = journal.replace(tiny, eval.selected_nodes, win.target_node);
+      if (saved >= 0) state.in_place++;
+    } else if (speculative) {
+      saved = journal.replace(*fs.synth, eval.selected_nodes, win.target_node);
+    }
+    if (saved < 0 && speculative) {
+      state.needs_import = true;
+      return 0;
+    }
+    if (saved < 0) {
+      std::vector<int> outputs = {win.target_node << 1};
+      aig.import(fs.synth, eval.selected_nodes, outputs);
+      if (aig.vvFanouts.empty()) {
+        aig.supportfanouts();
+      }
+    }
+    if (!speculative) journal.commit();
+    int actual_gain = gates_before - aig.nGates;
+    state.stamp.resize(aig.nObjs, epoch);
+    if (actual_gain != eval.gain || aig.vvFanouts.empty()) {
+      state.stamps_valid = false;
+      state.potentials_valid = false;
+    } else if (state.potentials_valid) {
+      // New nodes are created in topological order; rewired fanouts of the
+      // target may now sit above them
+      // (rollback truncates new nodes, so only old ones need undo entries)
+      auto& potential = state.potential;
+      potential.resize(aig.nObjs, 0);
+      for (int node = objs_before; node < aig.nObjs; node++) {
+        if (!is_node_accessible(aig, node)) continue;
+        potential[node] = std::max(potential[aig.vObjs[node * 2] >> 1], potential[aig.vObjs[node * 2 + 1] >> 1]) + 1;
+      }
+      raise_potentials(aig, state, target_fanouts);
+    }
+    if (!win.care.empty()) {
+      state.odc_changed.resize(aig.nObjs, 0);
+      for (size_t i = 0; i < win.local.flags.size(); i++) {
+        if (!(win.local.flags[i] & WindowSnapshot::ODC) || state.odc_changed[win.nodes[i]]) continue;
+        if (state.undo) state.odc_undo.push_back(win.nodes[i]);
+        state.odc_changed[win.nodes[i]] = 1;
+      }
+      state.any_odc_changed = true;
+    }
+    return actual_gain;
+  }
+
+  // Per-batch counters, discarded when a speculative batch is rolled back
+  struct BatchCounts {
+    int skipped = 0;
+    int reused = 0;
+    int revalidated = 0;
+    int rechecked = 0;
+    int predicted = 0;  // sum of the committed candidates' gains
+  };
+
+  int inserter_process_windows_heap(aigman& aig, std::vector<Window>& windows, bool verbose,
+                                    int batch_size, int num_threads, bool speculative) {
     if (verbose) {
       std::cout << "Building gain heap from windows and feasible sets...\n";
     }
@@ -34,14 +323,11 @@ namespace fresub {
     for (size_t wi = 0; wi < windows.size(); ++wi) {
       auto& win = windows[wi];
       for (size_t fi = 0; fi < win.feasible_sets.size(); ++fi) {
-        auto& fs = win.feasible_sets[fi];
-        for (size_t si = 0; si < fs.synths.size(); ++si) {
-          auto* synth = fs.synths[si];
-          if (!synth) continue;
-          int estimated_gain = win.mffc_size - synth->nGates;
-          assert(estimated_gain > 0 && "Non-beneficial candidate should be filtered before insertion heap");
-          heap.push(HeapItem{estimated_gain, static_cast<int>(wi), static_cast<int>(fi), static_cast<int>(si)});
-        }
+        auto* synth = win.feasible_sets[fi].synth;
+        if (!synth) continue;
+        int estimated_gain = win.mffc_size - synth->nGates;
+        assert(estimated_gain > 0 && "Non-beneficial candidate should be filtered before insertion heap");
+        heap.push(HeapItem{estimated_gain, static_cast<int>(wi), static_cast<int>(fi)});
       }
     }
 
@@ -50,71 +336,146 @@ namespace fresub {
     if (verbose) {
       std::cout << "Processing heap with " << heap.size() << " candidates...\n";
     }
-    // Reusable deref buffer for MFFC computation
-    std::vector<int> deref;
+    if (aig.vvFanouts.empty()) {
+      aig.supportfanouts();
+    }
+    InsertState state;
+    state.stamp.assign(aig.nObjs, 0);
+    state.potentials_valid = aig.fSorted;
+    if (state.potentials_valid) state.potential = compute_levels(aig);
+    batch_size = std::max(1, batch_size);
+    num_threads = std::max(1, num_threads);
+    std::vector<EvalScratch> scratch(num_threads);
+    int reused = 0;
+    int revalidated = 0;
+    int rechecked = 0;
+    int rolled_back = 0;
+    speculative = speculative && batch_size > 1;
+    AigJournal journal(aig);
+    std::vector<HeapItem> batch;
+    std::vector<Evaluation> evals;
     while (!heap.empty()) {
-      auto item = heap.top();
-      heap.pop();
-
-      auto& win = windows[item.window_idx];
-      auto& fs = win.feasible_sets[item.fs_idx];
-      if (item.synth_idx >= static_cast<int>(fs.synths.size())) continue;
-      aigman* synth = fs.synths[item.synth_idx];
-      if (!synth) continue; // may have been consumed/cleaned in a prior step
-
-      // Validate target and divisors still exist and are acyclic
-      if (!is_node_accessible(aig, win.target_node)) {
-        skipped++;
-        continue;
-      }
-      std::vector<int> selected_nodes;
-      selected_nodes.reserve(fs.divisor_indices.size());
-      for (int idx : fs.divisor_indices) {
-        int node = win.divisors[idx];
-        if (!is_node_accessible(aig, node)) { selected_nodes.clear(); break; }
-        selected_nodes.push_back(node);
+      // Pop the next batch (may hold consumed/cleaned sets from a prior step)
+      batch.clear();
+      while (!heap.empty() && static_cast<int>(batch.size()) < batch_size) {
+        auto item = heap.top();
+        heap.pop();
+        if (windows[item.window_idx].feasible_sets[item.fs_idx].synth) batch.push_back(item);
       }
-      if (selected_nodes.empty() && !fs.divisor_indices.empty()) {
-        skipped++;
-        continue;
-      }
-      if (!selected_nodes.empty()) {
-        std::vector<int> target_nodes = {win.target_node};
-        if (aig.reach(target_nodes, selected_nodes)) {
-          skipped++;
-          continue;
+
+      // Speculatively evaluate the batch against the AIG as it is now
+      evals.resize(batch.size());
+      parallel_for_chunks(0, static_cast<int>(batch.size()), num_threads, 1, [&](int b, int e, int t) {
+        for (int k = b; k < e; k++) {
+          const auto& win = windows[batch[k].window_idx];
+          evaluate_candidate(aig, win, win.feasible_sets[batch[k].fs_idx], batch[k].gain, state, scratch[t], evals[k]);
         }
-      }
+      });
 
-      // Recompute current MFFC-based gain for the target node
-      // Exclude selected divisors by priming their deref counts
-      auto mffc_now = compute_mffc_excluding_divisors(aig, win.target_node, deref, selected_nodes);
-      int current_gain = static_cast<int>(mffc_now.size()) - synth->nGates;
-      if (current_gain <= 0) {
-        // No longer beneficial after prior insertions
-        skipped++;
-        continue;
-      }
+      // Commit in gain order; candidates whose region an earlier commit of
+      // this batch dirtied are evaluated again. A speculative pass skips that
+      // re-evaluation and instead commits through the journal, measuring the
+      // batch's actual gain; if it falls short of the predicted gain, the
+      // batch is rolled back and committed again with re-evaluation.
+      int batch_epoch = applied;
+      auto commit_batch = [&](bool speculative_pass, BatchCounts& counts) {
+        for (size_t k = 0; k < batch.size(); k++) {
+          auto& win = windows[batch[k].window_idx];
+          auto& fs = win.feasible_sets[batch[k].fs_idx];
+          Evaluation* eval = &evals[k];
+          Evaluation redo;
+          if (applied > batch_epoch) {
+            std::vector<int> selected_nodes;
+            if (!candidate_alive(aig, win, fs, state, selected_nodes)) {
+              counts.skipped++;
+              continue;
+            }
+            if (!eval->ok || (!speculative_pass && evaluation_dirty(aig, win.target_node, *eval, state, batch_epoch))) {
+              evaluate_candidate(aig, win, fs, batch[k].gain, state, scratch[0], redo);
+              eval = &redo;
+              counts.rechecked++;
+            } else if (divisor_in_tfo(aig, state, win.target_node, eval->selected_nodes, scratch[0])) {
+              // Paths through new logic can reach divisors outside the region
+              counts.skipped++;
+              continue;
+            }
+          }
+          if (!eval->ok) {
+            counts.skipped++;
+            continue;
+          }
+          if (eval->reused) counts.reused++;
+          else counts.revalidated++;
 
-      // Import synthesized circuit to replace target
-      int gates_before = aig.nGates;
-      std::vector<int> outputs = {win.target_node << 1};
-      aig.import(synth, selected_nodes, outputs);
-      int actual_gain = gates_before - aig.nGates;
-      if (verbose) {
-        std::cout << "Applied candidate: target=" << win.target_node
-                  << ", divs=" << selected_nodes.size()
-                  << ", gates=" << synth->nGates
-                  << ", gain=" << current_gain
-                  << ", actual_gain=" << actual_gain << "\n";
+          int actual_gain = commit_candidate(aig, win, fs, *eval, state, applied + 1, journal, speculative_pass);
+          if (state.needs_import) return;
+          if (verbose) {
+            std::cout << "Applied candidate: target=" << win.target_node
+                      << ", divs=" << eval->selected_nodes.size()
+                      << ", gates=" << fs.synth->nGates
+                      << ", gain=" << eval->gain
+                      << ", actual_gain=" << actual_gain << "\n";
+          }
+          // Note: actual_gain may exceed the gain due to constant propagation and downstream simplifications;
+          // a speculative commit may fall short, which the batch check catches
+          assert(speculative_pass || actual_gain >= eval->gain);
+          counts.predicted += eval->gain;
+          applied++;
+        }
+      };
+
+      BatchCounts counts;
+      if (speculative && batch.size() > 1) {
+        int gates_before = aig.nGates;
+        bool stamps_valid = state.stamps_valid;
+        bool potentials_valid = state.potentials_valid;
+        bool any_odc_changed = state.any_odc_changed;
+        state.undo = true;
+        commit_batch(true, counts);
+        state.undo = false;
+        if (!state.needs_import && gates_before - aig.nGates >= counts.predicted) {
+          journal.commit();
+        } else {
+          if (verbose && state.needs_import) {
+            std::cout << "Rolled back batch: a replacement needs aig.import\n";
+          } else if (verbose) {
+            std::cout << "Rolled back batch: gain " << gates_before - aig.nGates
+                      << " below predicted " << counts.predicted << "\n";
+          }
+          state.needs_import = false;
+          journal.rollback();
+          for (auto it = state.potential_undo.rbegin(); it != state.potential_undo.rend(); ++it) {
+            state.potential[it->first] = it->second;
+          }
+          for (int node : state.odc_undo) state.odc_changed[node] = 0;
+          state.potential.resize(std::min<size_t>(state.potential.size(), aig.nObjs));
+          state.stamp.resize(aig.nObjs);
+          state.stamps_valid = stamps_valid;
+          state.potentials_valid = potentials_valid;
+          state.any_odc_changed = any_odc_changed;
+          applied = batch_epoch;
+          rolled_back++;
+          counts = BatchCounts();
+          commit_batch(false, counts);
+        }
+        state.potential_undo.clear();
+        state.odc_undo.clear();
+      } else {
+        commit_batch(false, counts);
       }
-      // Note: actual_gain may exceed current_gain due to constant propagation and downstream simplifications
-      assert(actual_gain >= current_gain);
-      applied++;
+      skipped += counts.skipped;
+      reused += counts.reused;
+      revalidated += counts.revalidated;
+      rechecked += counts.rechecked;
     }
 
     if (verbose) {
       std::cout << "Heap processing complete: " << applied << " applied, " << skipped << " skipped\n";
+      std::cout << "Candidate validation: " << reused << " reused, " << revalidated << " revalidated";
+      if (batch_size > 1) std::cout << ", " << rechecked << " rechecked in batch";
+      std::cout << "\n";
+      std::cout << "In-place rewrites: " << state.in_place << "\n";
+      if (speculative) std::cout << "Speculative batches rolled back: " << rolled_back << "\n";
     }
     return applied;
   }
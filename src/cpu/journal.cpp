@@ -0,0 +1,201 @@
+#include "journal.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "aig_utils.hpp"
+
+namespace fresub {
+
+  AigJournal::AigJournal(aigman& aig) : aig(aig) {
+    assert(!aig.vvFanouts.empty());
+    if (static_cast<int>(aig.vDeads.size()) < aig.nObjs) aig.vDeads.resize(aig.nObjs, false);
+    commit();
+  }
+
+  void AigJournal::set_fanin(int node, int slot, int lit) {
+    log.push_back(Entry{Op::FANIN, node, slot, aig.vObjs[node * 2 + slot]});
+    aig.vObjs[node * 2 + slot] = lit;
+  }
+
+  void AigJournal::add_fanout(int node, int fanout) {
+    log.push_back(Entry{Op::FANOUT_ADD, node, 0, fanout});
+    aig.vvFanouts[node].push_back(fanout);
+  }
+
+  void AigJournal::erase_fanout(int node, int fanout) {
+    // Search from the back: rewiring pops the target's list from the end
+    auto& fanouts = aig.vvFanouts[node];
+    auto rit = std::find(fanouts.rbegin(), fanouts.rend(), fanout);
+    assert(rit != fanouts.rend());
+    auto it = std::prev(rit.base());
+    log.push_back(Entry{Op::FANOUT_ERASE, node, static_cast<int>(it - fanouts.begin()), fanout});
+    fanouts.erase(it);
+  }
+
+  // Remove a gate left without fanouts, and recursively its fanins
+  void AigJournal::kill(int node) {
+    stack.assign(1, node);
+    while (!stack.empty()) {
+      int n = stack.back();
+      stack.pop_back();
+      if (n <= aig.nPis || aig.vDeads[n] || !aig.vvFanouts[n].empty()) continue;
+      log.push_back(Entry{Op::DEAD, n, 0, 0});
+      aig.vDeads[n] = true;
+      aig.nGates--;
+      for (int slot = 0; slot < 2; slot++) {
+        int fanin = lit2var(aig.vObjs[n * 2 + slot]);
+        erase_fanout(fanin, n);
+        stack.push_back(fanin);
+      }
+    }
+  }
+
+  bool TinyCircuit::from_aig(const aigman& synth, TinyCircuit& circuit) {
+    int num_gates = synth.nObjs - synth.nPis - 1;
+    if (synth.nPos != 1 || synth.nPis > MAX_INPUTS || num_gates > MAX_GATES) return false;
+    circuit.num_inputs = synth.nPis;
+    circuit.num_gates = num_gates;
+    std::copy(synth.vObjs.begin() + (synth.nPis + 1) * 2, synth.vObjs.begin() + synth.nObjs * 2, circuit.fanins);
+    circuit.output = synth.vPos[0];
+    return true;
+  }
+
+  int AigJournal::replace(const aigman& synth, const std::vector<int>& inputs, int target) {
+    assert(synth.nPos == 1);
+    return replace_gates(synth.nPis, synth.nObjs - synth.nPis - 1, synth.vObjs.data() + (synth.nPis + 1) * 2,
+                         synth.vPos[0], inputs, target);
+  }
+
+  int AigJournal::replace(const TinyCircuit& circuit, const std::vector<int>& inputs, int target) {
+    return replace_gates(circuit.num_inputs, circuit.num_gates, circuit.fanins, circuit.output, inputs, target);
+  }
+
+  // The journal copies gates literally; aig.import also propagates constants
+  // and folds AND(d, d) and AND(d, !d). Detect replacements where that matters:
+  // a constant driver, or a new or rewired gate with both fanins on one node.
+  bool AigJournal::needs_simplification(int num_inputs, int num_gates, const int* fanins, int output,
+                                        const std::vector<int>& inputs, int target) const {
+    // AIG node of a synth variable; new gates map to distinct negative ids
+    auto node_of = [&](int var) { return var == 0 ? 0 : var <= num_inputs ? inputs[var - 1] : -var; };
+    for (int g = 0; g < num_gates; g++) {
+      int n0 = node_of(lit2var(fanins[g * 2]));
+      int n1 = node_of(lit2var(fanins[g * 2 + 1]));
+      if (n0 == 0 || n1 == 0 || n0 == n1) return true;
+    }
+    int driver = node_of(lit2var(output));
+    if (driver == 0) return true;
+    // A new driver gate shares no fanout with existing nodes
+    if (driver < 0) return false;
+    for (int fo : aig.vvFanouts[target]) {
+      if (fo >= aig.nObjs) continue;
+      int n0 = lit2var(aig.vObjs[fo * 2]);
+      int n1 = lit2var(aig.vObjs[fo * 2 + 1]);
+      if (n0 == n1 || (n0 == target ? n1 : n0) == driver) return true;
+    }
+    return false;
+  }
+
+  int AigJournal::replace_gates(int num_inputs, int num_gates, const int* fanins, int output,
+                                const std::vector<int>& inputs, int target) {
+    assert(static_cast<int>(inputs.size()) == num_inputs);
+    if (needs_simplification(num_inputs, num_gates, fanins, output, inputs, target)) return -1;
+    if (static_cast<int>(aig.vDeads.size()) < aig.nObjs) aig.vDeads.resize(aig.nObjs, false);
+    int gates_before = aig.nGates;
+    int objs_before = aig.nObjs;
+
+    // Create the gates; new nodes are dropped by truncation on rollback
+    lits.resize(num_inputs + 1 + num_gates);
+    lits[0] = 0;
+    for (int i = 0; i < num_inputs; i++) lits[i + 1] = var2lit(inputs[i]);
+    for (int g = 0; g < num_gates; g++) {
+      int f0 = lits[lit2var(fanins[g * 2])] ^ (fanins[g * 2] & 1);
+      int f1 = lits[lit2var(fanins[g * 2 + 1])] ^ (fanins[g * 2 + 1] & 1);
+      int node = aig.newgate(f0, f1);
+      if (static_cast<int>(aig.vvFanouts.size()) < aig.nObjs) aig.vvFanouts.resize(aig.nObjs);
+      if (static_cast<int>(aig.vDeads.size()) < aig.nObjs) aig.vDeads.resize(aig.nObjs, false);
+      add_fanout(lit2var(f0), node);
+      add_fanout(lit2var(f1), node);
+      lits[num_inputs + 1 + g] = var2lit(node);
+    }
+    int driver = lits[lit2var(output)] ^ (output & 1);
+    assert(lit2var(driver) != target);
+
+    // Move the target's fanouts to the driver; entries beyond the node range
+    // are POs
+    bool drives_po = false;
+    auto& target_fanouts = aig.vvFanouts[target];
+    while (!target_fanouts.empty()) {
+      int fo = target_fanouts.back();
+      erase_fanout(target, fo);
+      add_fanout(lit2var(driver), fo);
+      if (fo >= aig.nObjs) {
+        drives_po = true;
+        continue;
+      }
+      for (int slot = 0; slot < 2; slot++) {
+        int lit = aig.vObjs[fo * 2 + slot];
+        if (lit2var(lit) != target) continue;
+        set_fanin(fo, slot, driver ^ (lit & 1));
+        break;
+      }
+    }
+    if (drives_po) {
+      for (int i = 0; i < aig.nPos; i++) {
+        int lit = aig.vPos[i];
+        if (lit2var(lit) != target) continue;
+        log.push_back(Entry{Op::PO, i, 0, lit});
+        aig.vPos[i] = driver ^ (lit & 1);
+      }
+    }
+
+    // Dereference the MFFC in place, then any unused new gate
+    kill(target);
+    for (int node = aig.nObjs - 1; node >= objs_before; node--) kill(node);
+    aig.fSorted = false;
+    return gates_before - aig.nGates;
+  }
+
+  void AigJournal::commit() {
+    log.clear();
+    base_objs = aig.nObjs;
+    base_gates = aig.nGates;
+    base_sorted = aig.fSorted;
+  }
+
+  void AigJournal::rollback() {
+    for (auto it = log.rbegin(); it != log.rend(); ++it) {
+      switch (it->op) {
+      case Op::FANIN:
+        aig.vObjs[it->node * 2 + it->pos] = it->value;
+        break;
+      case Op::PO:
+        aig.vPos[it->node] = it->value;
+        break;
+      case Op::DEAD:
+        aig.vDeads[it->node] = false;
+        break;
+      case Op::FANOUT_ADD: {
+        auto& fanouts = aig.vvFanouts[it->node];
+        assert(!fanouts.empty() && fanouts.back() == it->value);
+        fanouts.pop_back();
+        break;
+      }
+      case Op::FANOUT_ERASE: {
+        auto& fanouts = aig.vvFanouts[it->node];
+        fanouts.insert(fanouts.begin() + it->pos, it->value);
+        break;
+      }
+      }
+    }
+    aig.nObjs = base_objs;
+    aig.vObjs.resize(base_objs * 2);
+    aig.vvFanouts.resize(base_objs);
+    aig.vDeads.resize(base_objs);
+    aig.nGates = base_gates;
+    aig.fSorted = base_sorted;
+    log.clear();
+  }
+
+} // namespace fresub
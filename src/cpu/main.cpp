@@ -1,24 +1,33 @@
 #include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
+#include <iterator>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
 #include <cassert>
 #include <iostream>
 
 #include <aig.hpp>
 
+#include "aig_utils.hpp"
+#include "alloc_stats.hpp"
+#include "candidates.hpp"
+#include "cut_enum.hpp"
 #include "feasibility.hpp"
 #include "insertion.hpp"
+#include "numa.hpp"
+#include "parallel.hpp"
+#include "partition.hpp"
 #include "simulation.hpp"
+#include "spill.hpp"
 #include "synthesis.hpp"
+#include "truth_table_store.hpp"
 #include "window.hpp"
-
-// Forward declare CUDA functions to avoid requiring CUDA headers when not needed
-namespace fresub {
-  void feasibility_check_cuda(std::vector<Window>::iterator begin, std::vector<Window>::iterator end);
-  void feasibility_check_cuda_all(std::vector<Window>::iterator begin, std::vector<Window>::iterator end);
-}
+#include "window_cache.hpp"
 
 using namespace fresub;
 using namespace std::chrono;
@@ -33,8 +42,541 @@ struct Config {
     bool use_cuda = false;       // Default to CPU feasibility check
     bool use_cuda_all = false;   // Use CUDA to find all combinations
     bool feas_all = false;       // CPU feasibility: if true ALL, else MIN-SIZE
+    bool feas_first = false;     // CPU feasibility: stop at the first feasible set
+    bool feas_bitmap = false;    // ALL mode: collect results in per-window bitmaps
+    int max_sets_per_window = 0; // ALL mode: keep only the N best sets per window (0 = all)
+    bool feas_cache = false;     // CPU feasibility: share results across equivalent windows
+    std::string cache_file;      // on-disk simulation/feasibility cache across runs
+    int odc_depth = 0;           // TFO depth for observability don't-cares (0 = exact)
+    bool sdc = false;            // satisfiability don't-cares of window leaves
+    bool virtual_divisors = false; // MIN mode: AND/OR of divisor pairs before 4-resub
+    bool native_cuts = false;    // fresub cut enumerator instead of exopt's
+    int max_cuts = 0;            // native cuts: max non-trivial cuts per node (0 = all)
+    int num_threads = fresub::default_num_threads();
+    int insert_batch = 1;        // heap candidates evaluated in parallel per insertion step
+    bool insert_speculative = false; // commit batches unchecked, roll back if they lose gain
+    int partition_size = 0;      // optimize regions of at most this many gates (0 = whole AIG)
+    PartitionMode partition_mode = PartitionMode::LEVELS;
+    int shard = 0;               // --shard i/N: this process handles shard i ...
+    int num_shards = 0;          // ... of N (0 = no sharding)
+    std::string candidates_file; // write synthesized candidates here instead of inserting
+    std::vector<std::string> merge_files; // insert the candidates of these files
+    int synth_per_target = 0;    // synthesize at most this many sets per target node (0 = all)
+    int sdc_support = 16;        // max PI support for exhaustive SDC confirmation
+    std::string spill_dir;       // --spill: process windows in batches, candidates spilled here
+    int spill_mb = 256;          // --spill: truth-table memory per batch (MB)
+    bool numa = false;           // per-window stages on node-pinned workers
+    bool numa_steals = false;    // report cross-node steals of those workers
+    WindowOrder window_order = WindowOrder::CUT_ID;
 };
 
+// Per-pass counters and stage times reported with -s
+struct PassStats {
+  size_t windows = 0;
+  int successful_resubs = 0;
+  double cut_ms = 0, order_ms = 0, mffc_ms = 0, sim_ms = 0, feas_ms = 0, synth_ms = 0, insert_ms = 0;
+  double load_ms = 0;          // reading --merge-candidates files
+  double spill_ms = 0;         // --spill file writes and reads
+  SdcStats sdc;
+  bool window_cache = false;
+  size_t window_cache_hits = 0, window_cache_misses = 0, window_cache_appended = 0;
+  size_t feas_cache_hits = 0, feas_cache_misses = 0;
+  size_t consolidated = 0;     // feasible sets dropped by --synth-per-target
+  size_t tt_words = 0, tt_stored_words = 0;  // truth-table words referenced by windows / distinct
+  size_t spill_batches = 0, spill_bytes = 0;
+  size_t arena_sim_bytes = 0, arena_feas_bytes = 0;  // truth-table arena in use after each stage (max)
+  AllocStageStats alloc_extract, alloc_sim, alloc_feas, alloc_synth, alloc_insert;  // FRESUB_ALLOC_STATS builds
+  NumaStats numa_sim, numa_feas, numa_synth;  // --numa
+  size_t candidates = 0;       // written (--candidates) or loaded (--merge-candidates)
+  bool failed = false;         // candidate file I/O error
+
+  void add(const PassStats& o) {
+    windows += o.windows;
+    successful_resubs += o.successful_resubs;
+    cut_ms += o.cut_ms;
+    order_ms += o.order_ms;
+    mffc_ms += o.mffc_ms;
+    sim_ms += o.sim_ms;
+    feas_ms += o.feas_ms;
+    synth_ms += o.synth_ms;
+    insert_ms += o.insert_ms;
+    load_ms += o.load_ms;
+    spill_ms += o.spill_ms;
+    sdc.windows_with_sdc += o.sdc.windows_with_sdc;
+    sdc.unconfirmed += o.sdc.unconfirmed;
+    feas_cache_hits += o.feas_cache_hits;
+    feas_cache_misses += o.feas_cache_misses;
+    consolidated += o.consolidated;
+    tt_words += o.tt_words;
+    tt_stored_words += o.tt_stored_words;
+    spill_batches += o.spill_batches;
+    spill_bytes += o.spill_bytes;
+    arena_sim_bytes = std::max(arena_sim_bytes, o.arena_sim_bytes);
+    arena_feas_bytes = std::max(arena_feas_bytes, o.arena_feas_bytes);
+    alloc_extract.add(o.alloc_extract);
+    alloc_sim.add(o.alloc_sim);
+    alloc_feas.add(o.alloc_feas);
+    alloc_synth.add(o.alloc_synth);
+    alloc_insert.add(o.alloc_insert);
+    numa_sim.add(o.numa_sim);
+    numa_feas.add(o.numa_feas);
+    numa_synth.add(o.numa_synth);
+  }
+};
+
+static double elapsed_ms(high_resolution_clock::time_point from, high_resolution_clock::time_point to) {
+  return duration_cast<microseconds>(to - from).count() / 1000.0;
+}
+
+
+// Synthesize one feasible set with gate budget = mffc_size - 1.
+// Returns nullptr if the selected engine finds nothing within the budget.
+static aigman* synthesize_feasible_set(const Config& config, const Window& window, const DivisorIndices& indices) {
+  // Build binary relation for this feasible set
+  std::vector<std::vector<bool>> br;
+  generate_relation(window.truth_tables, indices, window.inputs.size(), br,
+                    window.care.empty() ? nullptr : window.care.data());
+
+  // Try selected synthesis engine with gate budget = mffc_size - 1
+  aigman* synthesized_aig = nullptr;
+  if (config.use_mockturtle) {
+    synthesized_aig = synthesize_circuit_mockturtle(br, window.mffc_size - 1);
+  } else {
+    synthesized_aig = synthesize_circuit(br, window.mffc_size - 1);
+  }
+  if (!synthesized_aig) {
+    if (config.verbose) {
+      std::cout << "  ✗ Synthesis failed for set {";
+      for (size_t i = 0; i < indices.size(); i++) {
+        if (i) std::cout << ", ";
+        std::cout << indices[i];
+      }
+      std::cout << "} within gate limit" << "\n";
+    }
+    return nullptr;
+  }
+  int gain = window.mffc_size - synthesized_aig->nGates;
+  assert(gain > 0 && "Synthesized candidate must be beneficial (gain > 0)");
+  if (config.verbose) {
+    std::cout << "  ✓ Synthesized set {";
+    for (size_t i = 0; i < indices.size(); i++) {
+      if (i) std::cout << ", ";
+      std::cout << indices[i];
+    }
+    std::cout << "}: " << synthesized_aig->nGates << " gates, gain=" << gain << "\n";
+  }
+  return synthesized_aig;
+}
+
+// Candidate files only merge into runs with the same cut settings
+static uint64_t candidate_salt(const Config& config) {
+  return static_cast<uint64_t>(config.max_cut_size) | (static_cast<uint64_t>(config.native_cuts) << 8) |
+         (static_cast<uint64_t>(config.max_cuts) << 16);
+}
+
+// Enumerate, order and analyze windows (the stages before simulation)
+static std::vector<Window> extract_windows(const Config& config, aigman& aig, PassStats& stats) {
+  AllocScope alloc_scope(stats.alloc_extract);
+  auto start_time = high_resolution_clock::now();
+
+  // Extract windows
+  if (config.verbose) {
+    std::cout << "Extracting windows with max cut size " << config.max_cut_size << "...\n";
+  }
+  // One read-only snapshot serves cut enumeration and the analysis below
+  AigSnapshot snapshot;
+  build_aig_snapshot(aig, config.num_threads, snapshot);
+  std::vector<Window> windows;
+  if (config.native_cuts) {
+    window_enumerate_all_native(snapshot, config.max_cut_size, config.max_cuts, config.num_threads, config.verbose, windows);
+  } else {
+    window_enumerate_all(aig, snapshot, config.max_cut_size, config.verbose, windows);
+  }
+  if (config.verbose) {
+    std::cout << "Extracted " << windows.size() << " windows\n";
+  }
+  auto cut_time = high_resolution_clock::now();
+  stats.cut_ms = elapsed_ms(start_time, cut_time);
+
+  // Order windows before the per-window stages so neighbours share cache
+  window_order(aig, windows, config.window_order);
+  auto order_time = high_resolution_clock::now();
+  stats.order_ms = elapsed_ms(cut_time, order_time);
+
+  // MFFC, TFO and divisors on the window-local snapshots
+  window_analyze_all(snapshot, windows, config.num_threads);
+  stats.mffc_ms = elapsed_ms(order_time, high_resolution_clock::now());
+  return windows;
+}
+
+static void delete_candidates(std::vector<Window>& windows) {
+  for (auto& win : windows) {
+    for (auto& fs : win.feasible_sets) {
+      delete fs.synth;
+      fs.synth = nullptr;
+    }
+  }
+}
+
+// Per-window stages from simulation through synthesis
+static void process_windows(const Config& config, aigman& aig, std::vector<Window>& windows, WindowCache& window_cache,
+                            bool use_window_cache, uint32_t cache_mode, FeasibilityCache& feas_cache, PassStats& stats) {
+  AllocScope sim_scope(stats.alloc_sim);
+  auto start_time = high_resolution_clock::now();
+  // --numa: windows run on workers pinned to nodes. A window is simulated on
+  // some node, whose arena then holds its truth tables, and is checked and
+  // synthesized there too unless another node's workers run out of work.
+  int num_windows = static_cast<int>(windows.size());
+  int stage_threads = config.numa && !config.verbose ? config.num_threads : 1;
+  const NumaTopology& topology = NumaTopology::system();
+  auto window_node = [&windows](int i) { return windows[i].numa_node; };
+  std::vector<char> cached(windows.size(), 0);
+  if (use_window_cache) {
+    for (size_t i = 0; i < windows.size(); i++) {
+      cached[i] = window_cache.lookup(windows[i], cache_mode);
+      if (cached[i]) windows[i].numa_node = numa_current_node();
+    }
+  }
+
+  // Compute truth tables
+  numa_parallel_for(0, num_windows, stage_threads, topology, window_node, [&](int i) {
+    if (cached[i]) return;
+    windows[i].truth_tables = compute_truth_tables_for_window(aig, windows[i], config.verbose);
+    windows[i].numa_node = numa_current_node();
+  }, &stats.numa_sim);
+  if (config.show_stats || config.verbose) {
+    // Rows are interned, so distinct rows are distinct pointers
+    std::unordered_set<const uint64_t*> distinct;
+    for (const auto& window : windows) {
+      for (const auto& tt : window.truth_tables) {
+        stats.tt_words += tt.size();
+        if (distinct.insert(tt.data()).second) stats.tt_stored_words += tt.size();
+      }
+    }
+  }
+  // Care masks also for cache hits: they mark the ODC region checked at insertion
+  if (config.odc_depth > 0) {
+    for (auto& window : windows) {
+      compute_window_care(window, config.odc_depth);
+    }
+  }
+  if (config.sdc) {
+    stats.sdc = compute_window_sdc(aig, windows, 16, config.sdc_support);
+  }
+  sim_scope.stop();
+  AllocScope feas_scope(stats.alloc_feas);
+  auto sim_time = high_resolution_clock::now();
+  stats.sim_ms += elapsed_ms(start_time, sim_time);
+  stats.arena_sim_bytes = std::max(stats.arena_sim_bytes, TruthTableStore::global().arena_stats().bytes);
+
+  // Feasibility check
+  auto run_cpu_check = [&](const FeasibilityCheck& check) {
+    if (!use_window_cache) {
+      if (config.feas_cache) {
+        feasibility_check_cached(windows.begin(), windows.end(), feas_cache, check);
+      } else if (stage_threads > 1) {
+        numa_parallel_for(0, num_windows, stage_threads, topology, window_node, [&](int i) {
+          check(windows.begin() + i, windows.begin() + i + 1);
+        }, &stats.numa_feas);
+      } else {
+        check(windows.begin(), windows.end());
+      }
+      return;
+    }
+    for (auto it = windows.begin(); it != windows.end(); ++it) {
+      size_t i = it - windows.begin();
+      if (cached[i]) continue;
+      if (config.feas_cache) {
+        feasibility_check_cached(it, it + 1, feas_cache, check);
+      } else {
+        check(it, it + 1);
+      }
+      window_cache.append(*it, cache_mode);
+    }
+  };
+  if (config.use_cuda_all) {
+    feasibility_check_cuda_all(windows.begin(), windows.end());
+  } else if (config.use_cuda) {
+    feasibility_check_cuda(windows.begin(), windows.end());
+  } else if (config.feas_first) {
+    run_cpu_check(feasibility_check_cpu_first);
+  } else if (config.max_sets_per_window > 0) {
+    // Rank by the sum of divisor levels (shallower divisors first)
+    std::vector<int> levels = compute_levels(aig);
+    feasibility_check_cpu_all_top(windows.begin(), windows.end(), config.max_sets_per_window, levels);
+  } else if (config.feas_bitmap) {
+    feasibility_check_cpu_all_bitmap(windows.begin(), windows.end());
+  } else if (config.feas_all) {
+    run_cpu_check(feasibility_check_cpu_all);
+  } else if (config.virtual_divisors) {
+    run_cpu_check(feasibility_check_cpu_min_virtual);
+  } else {
+    run_cpu_check(feasibility_check_cpu_min);
+  }
+  feas_scope.stop();
+  AllocScope synth_scope(stats.alloc_synth);
+  auto feas_time = high_resolution_clock::now();
+  stats.feas_ms += elapsed_ms(sim_time, feas_time);
+  stats.arena_feas_bytes = std::max(stats.arena_feas_bytes, TruthTableStore::global().arena_stats().bytes);
+  
+  // Only one candidate per target can be inserted; keep the most promising
+  if (config.synth_per_target > 0) {
+    stats.consolidated += consolidate_candidates(windows, config.synth_per_target);
+  }
+
+  // Synthesize for all remaining feasible sets; do not pre-filter before insertion
+  numa_parallel_for(0, num_windows, stage_threads, topology, window_node, [&](int i) {
+    Window& window = windows[i];
+    if (config.verbose) {
+      std::cout << "Processing window with target " << window.target_node
+		<< " (" << window.inputs.size() << " inputs, "
+		<< window.divisors.size() << " divisors)\n";
+    }    
+    size_t num_feasible = window.feasible_sets.size();
+    for (uint64_t word : window.feasible_bitmap) {
+      num_feasible += __builtin_popcountll(word);
+    }
+    if (num_feasible == 0) {
+      if (config.verbose) std::cout << "  No feasible resubstitution found\n";
+      window.feasible_bitmap.clear();
+      return;
+    }
+    if (config.verbose) {
+      std::cout << "  ✓ Found " << num_feasible << " feasible set(s)\n";
+    }
+    // For each feasible set, synthesize one circuit and store in FeasibleSet::synth
+    // (double-divisor matches already carry their structure)
+    for (auto& fs : window.feasible_sets) {
+      if (fs.synth) continue;
+      fs.synth = synthesize_feasible_set(config, window, fs.divisor_indices);
+    }
+    // Bitmap results: only sets that synthesize are materialized
+    for (size_t w = 0; w < window.feasible_bitmap.size(); w++) {
+      for (uint64_t bits = window.feasible_bitmap[w]; bits; bits &= bits - 1) {
+        DivisorIndices indices = combination_unrank(w * 64 + __builtin_ctzll(bits), window.feasible_k);
+        aigman* synthesized_aig = synthesize_feasible_set(config, window, indices);
+        if (!synthesized_aig) continue;
+        FeasibleSet fs;
+        fs.synth = synthesized_aig;
+        fs.window_id = window.cut_id;
+        fs.divisor_indices = indices;
+        window.feasible_sets.push_back(fs);
+      }
+    }
+    window.feasible_bitmap.clear();
+    window.feasible_bitmap.shrink_to_fit();
+  }, &stats.numa_synth);
+  
+  stats.synth_ms += elapsed_ms(feas_time, high_resolution_clock::now());
+}
+
+// Truth-table words a window needs at most (rows are shared across windows)
+static size_t truth_table_words(const Window& window) {
+  size_t num_words = ((size_t(1) << window.inputs.size()) + 63) / 64;
+  return (window.divisors.size() + 1) * num_words;
+}
+
+// Sharding: keep this process's share of the windows (cut IDs are global)
+static void keep_shard(const Config& config, std::vector<Window>& windows) {
+  if (config.num_shards == 0) return;
+  windows.erase(std::remove_if(windows.begin(), windows.end(), [&config](const Window& w) {
+    return !in_shard(w.cut_id, config.shard, config.num_shards);
+  }), windows.end());
+}
+
+// --spill: the windows of the pass never all exist in memory. They are
+// created a run of targets at a time, analyzed, and run through simulation,
+// feasibility and synthesis in batches whose truth tables fit in
+// config.spill_mb. Only windows with candidates are written to the spill
+// file; those are read back and ordered for insertion. num_windows counts
+// the windows of this shard.
+static bool process_windows_spilled(const Config& config, aigman& aig, std::vector<Window>& windows, WindowCache& window_cache,
+                                    bool use_window_cache, uint32_t cache_mode, FeasibilityCache& feas_cache,
+                                    size_t& num_windows, PassStats& stats) {
+  SpillFile spill;
+  if (!spill.open(config.spill_dir)) return false;
+  size_t cap_words = (static_cast<size_t>(config.spill_mb) << 20) / sizeof(uint64_t);
+
+  AllocScope cut_scope(stats.alloc_extract);
+  auto start_time = high_resolution_clock::now();
+  AigSnapshot snapshot;
+  build_aig_snapshot(aig, config.num_threads, snapshot);
+  std::unique_ptr<WindowStream> stream;
+  if (config.native_cuts) {
+    stream.reset(new WindowStream(snapshot, config.max_cut_size, config.max_cuts, config.num_threads, config.verbose));
+  } else {
+    stream.reset(new WindowStream(aig, snapshot, config.max_cut_size, config.verbose));
+  }
+  cut_scope.stop();
+  stats.cut_ms += elapsed_ms(start_time, high_resolution_clock::now());
+
+  // The first run is small; later ones are sized from the truth-table words
+  // per window seen so far, so a run holds about one batch
+  size_t run_windows = 1024;
+  size_t seen_windows = 0, seen_words = 0;
+  std::vector<Window> run, batch;
+  std::vector<SpillFile::Segment> results;
+  while (true) {
+    AllocScope extract_scope(stats.alloc_extract);
+    auto run_start = high_resolution_clock::now();
+    if (!stream->next(run, run_windows)) break;
+    keep_shard(config, run);
+    auto cut_time = high_resolution_clock::now();
+    stats.cut_ms += elapsed_ms(run_start, cut_time);
+    window_order(aig, run, config.window_order);
+    auto order_time = high_resolution_clock::now();
+    stats.order_ms += elapsed_ms(cut_time, order_time);
+    window_analyze_all(snapshot, run, config.num_threads);
+    stats.mffc_ms += elapsed_ms(order_time, high_resolution_clock::now());
+    extract_scope.stop();
+    num_windows += run.size();
+
+    size_t begin = 0;
+    while (begin < run.size()) {
+      size_t end = begin;
+      size_t words = 0;
+      do {
+        words += truth_table_words(run[end++]);
+      } while (end < run.size() && words + truth_table_words(run[end]) <= cap_words);
+      seen_windows += end - begin;
+      seen_words += words;
+      batch.assign(std::make_move_iterator(run.begin() + begin), std::make_move_iterator(run.begin() + end));
+      process_windows(config, aig, batch, window_cache, use_window_cache, cache_mode, feas_cache, stats);
+      auto last = std::stable_partition(batch.begin(), batch.end(), [](const Window& window) {
+        return std::any_of(window.feasible_sets.begin(), window.feasible_sets.end(),
+                           [](const FeasibleSet& fs) { return fs.synth != nullptr; });
+      });
+      auto io_start = high_resolution_clock::now();
+      results.emplace_back();
+      bool written = spill.append(batch.begin(), last, results.back());
+      delete_candidates(batch);
+      if (!written) return false;
+      stats.spill_ms += elapsed_ms(io_start, high_resolution_clock::now());
+      stats.spill_batches++;
+      begin = end;
+    }
+    if (seen_words > 0) run_windows = std::max<size_t>(1, seen_windows * cap_words / seen_words);
+  }
+  std::vector<Window>().swap(run);
+  std::vector<Window>().swap(batch);
+  stats.spill_bytes += spill.size();
+
+  auto io_start = high_resolution_clock::now();
+  for (const auto& segment : results) {
+    if (spill.load(segment, windows) < 0) return false;
+  }
+  auto load_time = high_resolution_clock::now();
+  stats.spill_ms += elapsed_ms(io_start, load_time);
+  // Insert in the order of an in-memory run
+  window_order(aig, windows, config.window_order);
+  stats.order_ms += elapsed_ms(load_time, high_resolution_clock::now());
+  return true;
+}
+
+// One resubstitution pass over the whole AIG: windows, simulation,
+// feasibility, synthesis and insertion. With --candidates, the synthesized
+// sets of this shard are written out instead of inserted.
+static PassStats run_pass(const Config& config, aigman& aig) {
+  PassStats stats;
+
+  // Previously: excluded windows with <4 divisors. Now process all windows.
+  
+  // Persistent cache: hits skip simulation and feasibility. Results depend on
+  // the feasibility mode, so only the CPU MIN/ALL/FIRST modes are cached.
+  WindowCache window_cache;
+  // SDCs depend on logic outside the window, which the structural key does not cover
+  bool use_window_cache = !config.cache_file.empty() && !config.use_cuda && !config.use_cuda_all &&
+                          !config.feas_bitmap && config.max_sets_per_window == 0 && !config.sdc;
+  // Low byte: feasibility mode; above it: ODC depth (care masks change results)
+  uint32_t cache_mode = (config.feas_first ? 2 : config.feas_all ? 1 : config.virtual_divisors ? 3 : 0) | (static_cast<uint32_t>(config.odc_depth) << 8);
+  if (!config.cache_file.empty() && !use_window_cache) {
+    std::cerr << "Warning: --cache-file is only supported with CPU MIN/ALL/FIRST feasibility without --sdc; ignored\n";
+  }
+  if (use_window_cache && !window_cache.open(config.cache_file)) {
+    use_window_cache = false;
+  }
+  FeasibilityCache feas_cache;
+  // --spill extracts windows itself and only keeps those with candidates
+  std::vector<Window> windows;
+  size_t num_windows = 0;
+  if (config.spill_dir.empty()) {
+    windows = extract_windows(config, aig, stats);
+    keep_shard(config, windows);
+    num_windows = windows.size();
+    process_windows(config, aig, windows, window_cache, use_window_cache, cache_mode, feas_cache, stats);
+  } else if (!process_windows_spilled(config, aig, windows, window_cache, use_window_cache, cache_mode, feas_cache,
+                                      num_windows, stats)) {
+    delete_candidates(windows);
+    stats.failed = true;
+    return stats;
+  }
+  stats.window_cache = use_window_cache;
+  stats.window_cache_hits = window_cache.hits;
+  stats.window_cache_misses = window_cache.misses;
+  stats.window_cache_appended = window_cache.appended;
+  stats.feas_cache_hits = feas_cache.hits;
+  stats.feas_cache_misses = feas_cache.misses;
+  auto synth_time = high_resolution_clock::now();
+  
+  stats.windows = num_windows;
+  if (!config.candidates_file.empty()) {
+    // The AIG is unchanged, so the fingerprint matches the merging run's
+    uint64_t fingerprint = candidate_fingerprint(aig, candidate_salt(config));
+    stats.failed = !write_candidates(config.candidates_file, fingerprint, windows);
+    for (const auto& win : windows) {
+      for (const auto& fs : win.feasible_sets) stats.candidates += fs.synth != nullptr;
+    }
+    stats.insert_ms = elapsed_ms(synth_time, high_resolution_clock::now());
+    delete_candidates(windows);
+    return stats;
+  }
+
+  // Insertion via heap over (window, feasible_set) candidates
+  if (config.verbose) {
+    std::cout << "\nProcessing candidates via gain-ordered heap...\n";
+  }
+  {
+    AllocScope alloc_scope(stats.alloc_insert);
+    stats.successful_resubs = inserter_process_windows_heap(aig, windows, config.verbose, config.insert_batch, config.num_threads, config.insert_speculative);
+  }
+  auto insert_time = high_resolution_clock::now();
+  stats.insert_ms = elapsed_ms(synth_time, insert_time);
+
+  // Cleanup: delete any remaining synthesized AIGs to avoid leaks
+  delete_candidates(windows);
+  return stats;
+}
+
+// Insert the candidates of all --merge-candidates files in one heap pass
+static PassStats run_merge(const Config& config, aigman& aig) {
+  PassStats stats;
+  std::vector<Window> windows = extract_windows(config, aig, stats);
+  stats.windows = windows.size();
+  auto load_start = high_resolution_clock::now();
+  uint64_t fingerprint = candidate_fingerprint(aig, candidate_salt(config));
+  for (const auto& path : config.merge_files) {
+    int count = read_candidates(path, fingerprint, windows);
+    if (count < 0) {
+      stats.failed = true;
+      delete_candidates(windows);
+      return stats;
+    }
+    stats.candidates += count;
+  }
+  auto load_time = high_resolution_clock::now();
+  stats.load_ms = elapsed_ms(load_start, load_time);
+
+  if (config.verbose) {
+    std::cout << "\nProcessing " << stats.candidates << " merged candidates via gain-ordered heap...\n";
+  }
+  {
+    AllocScope alloc_scope(stats.alloc_insert);
+    stats.successful_resubs = inserter_process_windows_heap(aig, windows, config.verbose, config.insert_batch, config.num_threads, config.insert_speculative);
+  }
+  stats.insert_ms = elapsed_ms(load_time, high_resolution_clock::now());
+  delete_candidates(windows);
+  return stats;
+}
 
 int main(int argc, char** argv) {
   // Read arguments
@@ -56,6 +598,83 @@ int main(int argc, char** argv) {
       config.use_cuda_all = true;
     } else if (strcmp(argv[i], "--feas-all") == 0) {
       config.feas_all = true;
+    } else if (strcmp(argv[i], "--feas-cache") == 0) {
+      config.feas_cache = true;
+    } else if (strcmp(argv[i], "--odc-depth") == 0 && i + 1 < argc) {
+      config.odc_depth = std::atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--sdc") == 0) {
+      config.sdc = true;
+    } else if (strcmp(argv[i], "--sdc-support") == 0 && i + 1 < argc) {
+      config.sdc = true;
+      config.sdc_support = std::atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--cache-file") == 0 && i + 1 < argc) {
+      config.cache_file = argv[++i];
+    } else if (strcmp(argv[i], "--native-cuts") == 0) {
+      config.native_cuts = true;
+    } else if (strcmp(argv[i], "--max-cuts") == 0 && i + 1 < argc) {
+      config.native_cuts = true;
+      config.max_cuts = std::atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      config.num_threads = std::max(1, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--insert-batch") == 0 && i + 1 < argc) {
+      config.insert_batch = std::max(1, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--insert-speculative") == 0) {
+      config.insert_speculative = true;
+    } else if (strcmp(argv[i], "--spill") == 0 && i + 1 < argc) {
+      config.spill_dir = argv[++i];
+    } else if (strcmp(argv[i], "--spill-mb") == 0 && i + 1 < argc) {
+      config.spill_mb = std::max(1, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--numa") == 0) {
+      config.numa = true;
+    } else if (strcmp(argv[i], "--numa-steals") == 0) {
+      config.numa = true;
+      config.numa_steals = true;
+    } else if (strcmp(argv[i], "--partition") == 0 && i + 1 < argc) {
+      config.partition_size = std::atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--partition-mode") == 0 && i + 1 < argc) {
+      const char* mode = argv[++i];
+      if (strcmp(mode, "levels") == 0) {
+        config.partition_mode = PartitionMode::LEVELS;
+      } else if (strcmp(mode, "cones") == 0) {
+        config.partition_mode = PartitionMode::CONES;
+      } else {
+        std::cerr << "Unknown partition mode: " << mode << "\n";
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+      if (std::sscanf(argv[++i], "%d/%d", &config.shard, &config.num_shards) != 2 ||
+          config.num_shards < 1 || config.shard < 0 || config.shard >= config.num_shards) {
+        std::cerr << "Invalid shard: " << argv[i] << " (expected i/N with 0 <= i < N)\n";
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--candidates") == 0 && i + 1 < argc) {
+      config.candidates_file = argv[++i];
+    } else if (strcmp(argv[i], "--merge-candidates") == 0 && i + 1 < argc) {
+      config.merge_files.push_back(argv[++i]);
+    } else if (strcmp(argv[i], "--synth-per-target") == 0 && i + 1 < argc) {
+      config.synth_per_target = std::atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--virtual-divisors") == 0) {
+      config.virtual_divisors = true;
+    } else if (strcmp(argv[i], "--feas-first") == 0) {
+      config.feas_first = true;
+    } else if (strcmp(argv[i], "--feas-bitmap") == 0) {
+      config.feas_all = true;
+      config.feas_bitmap = true;
+    } else if (strcmp(argv[i], "--max-sets-per-window") == 0 && i + 1 < argc) {
+      config.feas_all = true;
+      config.max_sets_per_window = std::atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--order") == 0 && i + 1 < argc) {
+      const char* order = argv[++i];
+      if (strcmp(order, "cut") == 0) {
+        config.window_order = WindowOrder::CUT_ID;
+      } else if (strcmp(order, "level") == 0) {
+        config.window_order = WindowOrder::LEVEL;
+      } else if (strcmp(order, "locality") == 0) {
+        config.window_order = WindowOrder::LOCALITY;
+      } else {
+        std::cerr << "Unknown window order: " << order << "\n";
+        return 1;
+      }
     } else if (argv[i][0] != '-') {
       if (config.input_file.empty()) {
 	config.input_file = argv[i];
@@ -70,11 +689,54 @@ int main(int argc, char** argv) {
     std::cerr << "  -c <size>     Max cut size (default: 4)\n";
     std::cerr << "  -v            Verbose output\n";
     std::cerr << "  -s            Show statistics\n";
+    std::cerr << "  --native-cuts Use fresub's parallel cut enumerator (max cut size 8)\n";
+    std::cerr << "  --max-cuts <n>  Native cuts: keep the n smallest cuts per node (default: 0 = all)\n";
+    std::cerr << "  --threads <n> Worker threads (default: hardware concurrency)\n";
+    std::cerr << "  --insert-batch <m>  Evaluate the top m insertion candidates in parallel (default: 1)\n";
+    std::cerr << "  --insert-speculative  Commit each batch without re-checks; roll it back if it loses gain\n";
+    std::cerr << "  --spill <dir>  Process windows in batches, spilling candidates to a temporary file in dir\n";
+    std::cerr << "  --spill-mb <n>  Truth-table memory per spill batch in MB (default: 256)\n";
+    std::cerr << "  --numa        Simulate, check and synthesize windows on node-pinned workers with per-node arenas\n";
+    std::cerr << "  --numa-steals  --numa, and report windows run on a node other than their own\n";
+    std::cerr << "  --partition <n>  Optimize regions of at most n gates in parallel and stitch them\n";
+    std::cerr << "  --partition-mode <m>  Region shape: levels (default), cones\n";
+    std::cerr << "  --shard <i/N> Only process windows of shard i out of N\n";
+    std::cerr << "  --candidates <path>  Write synthesized candidates to a file instead of inserting\n";
+    std::cerr << "  --merge-candidates <path>  Insert candidates from a file (repeatable)\n";
+    std::cerr << "  --synth-per-target <n>  Synthesize only the n most promising feasible sets per target (default: 0 = all)\n";
     std::cerr << "  --exopt       Use SAT-based synthesis (exopt)\n";
     std::cerr << "  --mockturtle  Use library-based synthesis (mockturtle, default)\n";
     std::cerr << "  --cuda        Use CUDA for feasibility checking (first solution)\n";
     std::cerr << "  --cuda-all    Use CUDA for feasibility checking (all solutions)\n";
     std::cerr << "  --feas-all    CPU feasibility: ALL mode (default is MIN-SIZE)\n";
+    std::cerr << "  --feas-cache  CPU feasibility: reuse results of windows with the same function\n";
+    std::cerr << "  --odc-depth <n>  Observability don't-cares from the target's TFO up to depth n (default: 0 = off)\n";
+    std::cerr << "  --sdc         Satisfiability don't-cares of window leaves (global simulation)\n";
+    std::cerr << "  --sdc-support <n>  Max PI support for exhaustive SDC confirmation (default: 16)\n";
+    std::cerr << "  --cache-file <path>  Persistent window cache (CPU MIN/ALL/FIRST modes)\n";
+    std::cerr << "  --feas-first  CPU feasibility: first feasible set at the smallest size\n";
+    std::cerr << "  --virtual-divisors  CPU MIN mode: try AND/OR of divisor pairs before 4-resub\n";
+    std::cerr << "  --feas-bitmap ALL mode with per-window result bitmaps (no per-set allocation)\n";
+    std::cerr << "  --max-sets-per-window <n>  ALL mode keeping the n best sets per window\n";
+    std::cerr << "  --order <o>   Window processing order: cut (default), level, locality\n";
+    return 1;
+  }
+  
+  if (config.native_cuts && (config.max_cut_size < 1 || config.max_cut_size > InlineCut::MAX_LEAVES)) {
+    std::cerr << "Error: --native-cuts supports cut sizes 1.." << InlineCut::MAX_LEAVES << "\n";
+    return 1;
+  }
+  
+  if (config.partition_size > 0 && (config.num_shards > 0 || !config.candidates_file.empty() || !config.merge_files.empty())) {
+    std::cerr << "Error: --partition cannot be combined with sharding or candidate files\n";
+    return 1;
+  }
+  if (!config.merge_files.empty() && !config.spill_dir.empty()) {
+    std::cerr << "Error: --merge-candidates runs insertion only; it cannot be combined with --spill\n";
+    return 1;
+  }
+  if (!config.merge_files.empty() && (config.num_shards > 0 || !config.candidates_file.empty())) {
+    std::cerr << "Error: --merge-candidates runs insertion only; it cannot be combined with --shard or --candidates\n";
     return 1;
   }
   
@@ -94,8 +756,16 @@ int main(int argc, char** argv) {
       std::cout << "Using CUDA feasibility checking (all combinations)\n";
     } else if (config.use_cuda) {
       std::cout << "Using CUDA feasibility checking (first combination)\n";
+    } else if (config.feas_first) {
+      std::cout << "Using CPU feasibility (FIRST mode)\n";
+    } else if (config.max_sets_per_window > 0) {
+      std::cout << "Using CPU feasibility (ALL mode, best " << config.max_sets_per_window << " per window)\n";
+    } else if (config.feas_bitmap) {
+      std::cout << "Using CPU feasibility (ALL mode, bitmap results)\n";
     } else if (config.feas_all) {
       std::cout << "Using CPU feasibility (ALL mode)\n";
+    } else if (config.virtual_divisors) {
+      std::cout << "Using CPU feasibility (MIN-SIZE mode, virtual divisors)\n";
     } else {
       std::cout << "Using CPU feasibility (MIN-SIZE mode)\n";
     }
@@ -103,113 +773,93 @@ int main(int argc, char** argv) {
 
   // Start measurement
   auto start_time = high_resolution_clock::now();
-        
-  // Extract windows
-  if (config.verbose) {
-    std::cout << "Extracting windows with max cut size " << config.max_cut_size << "...\n";
-  }
-  std::vector<Window> windows;
-  window_extract_all(aig, config.max_cut_size, config.verbose, windows);
-  if (config.verbose) {
-    std::cout << "Extracted " << windows.size() << " windows\n";
-  }
-
-  // Previously: excluded windows with <4 divisors. Now process all windows.
-  
-  // Compute truth tables
-  for (auto& window : windows) {
-    window.truth_tables = compute_truth_tables_for_window(aig, window, config.verbose);
-  }
-
-  // Feasibility check
-  if (config.use_cuda_all) {
-    feasibility_check_cuda_all(windows.begin(), windows.end());
-  } else if (config.use_cuda) {
-    feasibility_check_cuda(windows.begin(), windows.end());
-  } else if (config.feas_all) {
-    feasibility_check_cpu_all(windows.begin(), windows.end());
+  PassStats stats;
+  int num_partitions = 0;
+  if (config.partition_size > 0) {
+    // Regions run one per thread; the persistent cache is not shared
+    Config region_config = config;
+    region_config.verbose = false;
+    region_config.cache_file.clear();
+    region_config.num_threads = 1;
+    std::mutex stats_mutex;
+    num_partitions = optimize_partitioned(aig, config.partition_size, config.partition_mode, config.num_threads, [&](aigman& region) {
+      PassStats region_stats = run_pass(region_config, region);
+      TruthTableStore::global().release_memory();
+      std::lock_guard<std::mutex> lock(stats_mutex);
+      stats.add(region_stats);
+    });
+  } else if (!config.merge_files.empty()) {
+    stats = run_merge(config, aig);
   } else {
-    feasibility_check_cpu_min(windows.begin(), windows.end());
-  }
-  
-  // Synthesize for all feasible sets; do not pre-filter before insertion
-  for (auto& window : windows) {
-    if (config.verbose) {
-      std::cout << "Processing window with target " << window.target_node
-		<< " (" << window.inputs.size() << " inputs, "
-		<< window.divisors.size() << " divisors)\n";
-    }    
-    if (window.feasible_sets.empty()) {
-      if (config.verbose) std::cout << "  No feasible resubstitution found\n";
-      continue;
-    }
-    if (config.verbose) {
-      std::cout << "  ✓ Found " << window.feasible_sets.size() << " feasible set(s)\n";
-    }
-    // For each feasible set, synthesize one circuit and store in FeasibleSet::synths
-    for (auto& fs : window.feasible_sets) {
-      // Build binary relation for this feasible set
-      std::vector<std::vector<bool>> br;
-      generate_relation(window.truth_tables, fs.divisor_indices, window.inputs.size(), br);
-
-      // Try selected synthesis engine with gate budget = mffc_size - 1
-      aigman* synthesized_aig = nullptr;
-      if (config.use_mockturtle) {
-        synthesized_aig = synthesize_circuit_mockturtle(br, window.mffc_size - 1);
-      } else {
-        synthesized_aig = synthesize_circuit(br, window.mffc_size - 1);
-      }
-      if (!synthesized_aig) {
-        if (config.verbose) {
-          std::cout << "  ✗ Synthesis failed for set {";
-          for (size_t i = 0; i < fs.divisor_indices.size(); i++) {
-            if (i) std::cout << ", ";
-            std::cout << fs.divisor_indices[i];
-          }
-          std::cout << "} within gate limit" << "\n";
-        }
-        continue;
-      }
-      int gain = window.mffc_size - synthesized_aig->nGates;
-      assert(gain > 0 && "Synthesized candidate must be beneficial (gain > 0)");
-      if (config.verbose) {
-        std::cout << "  ✓ Synthesized set {";
-        for (size_t i = 0; i < fs.divisor_indices.size(); i++) {
-          if (i) std::cout << ", ";
-          std::cout << fs.divisor_indices[i];
-        }
-        std::cout << "}: " << synthesized_aig->nGates << " gates, gain=" << gain << "\n";
-      }
-      fs.synths.push_back(synthesized_aig);
-    }
-  }
-  
-  // Insertion via heap over (window, feasible_set) candidates
-  if (config.verbose) {
-    std::cout << "\nProcessing candidates via gain-ordered heap...\n";
-  }
-  int successful_resubs = inserter_process_windows_heap(aig, windows, config.verbose);
-
-  // Cleanup: delete any remaining synthesized AIGs to avoid leaks
-  for (auto& win : windows) {
-    for (auto& fs : win.feasible_sets) {
-      for (auto*& s : fs.synths) {
-        if (s) { delete s; s = nullptr; }
-      }
-      fs.synths.clear();
-    }
+    stats = run_pass(config, aig);
   }
+  HugePageArena::Stats arena = TruthTableStore::global().arena_stats();
+  TruthTableStore::global().release_memory();
+  if (stats.failed) return 1;
   
   // Final statistics
   auto end_time = high_resolution_clock::now();
   auto duration = duration_cast<milliseconds>(end_time - start_time);
   int final_gates = aig.nGates;
-  // successful_resubs already computed
   if (config.show_stats || config.verbose) {
     std::cout << "\nResubstitution complete:\n";
-    std::cout << "  Windows extracted: " << windows.size() << "\n";
-    std::cout << "  Successful resubstitutions: " << successful_resubs << "\n";
+    if (num_partitions > 0) {
+      std::cout << "  Partitions: " << num_partitions << " (stage times summed over partitions)\n";
+    }
+    std::cout << "  Windows extracted: " << stats.windows << "\n";
+    if (!config.candidates_file.empty()) {
+      std::cout << "  Candidates written: " << stats.candidates << "\n";
+    } else if (!config.merge_files.empty()) {
+      std::cout << "  Candidates loaded: " << stats.candidates << " from " << config.merge_files.size() << " file(s)\n";
+    }
+    if (!config.spill_dir.empty()) {
+      std::cout << "  Spill: " << stats.spill_batches << " batches, " << stats.spill_bytes << " bytes\n";
+    }
+    if (config.synth_per_target > 0) {
+      std::cout << "  Feasible sets dropped before synthesis: " << stats.consolidated << "\n";
+    }
+    std::cout << "  Successful resubstitutions: " << stats.successful_resubs << "\n";
     std::cout << "  Time: " << duration.count() << " ms\n";
+    std::cout << "    Cut enumeration: " << stats.cut_ms << " ms\n";
+    std::cout << "    Window ordering: " << stats.order_ms << " ms\n";
+    std::cout << "    MFFC/TFO: " << stats.mffc_ms << " ms\n";
+    std::cout << "    Simulation: " << stats.sim_ms << " ms\n";
+    std::cout << "      Truth tables: " << stats.tt_words << " words in windows, " << stats.tt_stored_words << " stored\n";
+    std::cout << "      Arena: " << stats.arena_sim_bytes << " bytes\n";
+    if (config.sdc) {
+      std::cout << "      SDC: " << stats.sdc.windows_with_sdc << " windows with don't-cares, "
+                << stats.sdc.unconfirmed << " unconfirmed\n";
+    }
+    std::cout << "    Feasibility: " << stats.feas_ms << " ms\n";
+    std::cout << "      Arena: " << stats.arena_feas_bytes << " bytes\n";
+    if (stats.window_cache) {
+      std::cout << "      Cache file: " << stats.window_cache_hits << " hits, " << stats.window_cache_misses << " misses, "
+                << stats.window_cache_appended << " appended\n";
+    }
+    if (config.feas_cache) {
+      std::cout << "      Cache: " << stats.feas_cache_hits << " hits, " << stats.feas_cache_misses << " misses\n";
+    }
+    std::cout << "    Synthesis: " << stats.synth_ms << " ms\n";
+    if (!config.merge_files.empty()) {
+      std::cout << "    Candidate loading: " << stats.load_ms << " ms\n";
+    }
+    if (!config.spill_dir.empty()) {
+      std::cout << "    Spill I/O: " << stats.spill_ms << " ms\n";
+    }
+    std::cout << "    Insertion: " << stats.insert_ms << " ms\n";
+#ifdef FRESUB_ALLOC_STATS
+    std::cout << "  Allocations (count, bytes, peak live bytes):\n";
+    auto print_alloc = [](const char* stage, const AllocStageStats& a) {
+      std::cout << "    " << stage << ": " << a.allocations << ", " << a.bytes << ", " << a.peak_live_bytes << "\n";
+    };
+    print_alloc("Extraction", stats.alloc_extract);
+    print_alloc("Simulation", stats.alloc_sim);
+    print_alloc("Feasibility", stats.alloc_feas);
+    print_alloc("Synthesis", stats.alloc_synth);
+    print_alloc("Insertion", stats.alloc_insert);
+#endif
+    std::cout << "  Truth-table arena: peak " << arena.peak_bytes << " bytes, " << arena.huge_pages << " huge pages, "
+              << arena.thp_pages << " transparent huge pages\n";
     std::cout << "  Initial gates: " << initial_gates << "\n";
     std::cout << "  Final gates: " << final_gates << "\n";
     int gate_change = final_gates - initial_gates;
@@ -222,6 +872,17 @@ int main(int argc, char** argv) {
     }
   }
   
+  if (config.numa_steals) {
+    auto print_steals = [](const char* stage, const NumaStats& n) {
+      std::cout << " " << stage << " " << n.steals << "/" << n.items;
+    };
+    std::cout << "NUMA: " << NumaTopology::system().num_nodes() << " node(s), cross-node steals:";
+    print_steals("simulation", stats.numa_sim);
+    print_steals("feasibility", stats.numa_feas);
+    print_steals("synthesis", stats.numa_synth);
+    std::cout << "\n";
+  }
+
   // Write output if specified
   if (!config.output_file.empty()) {
     if (config.verbose) {
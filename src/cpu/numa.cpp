@@ -0,0 +1,64 @@
+#include "numa.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace fresub {
+
+  static thread_local int current_node = 0;
+
+  // Parse a kernel CPU list such as "0-3,8,10-11"
+  static std::vector<int> parse_cpulist(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream ss(text);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+      if (range.empty() || range == "\n") continue;
+      size_t dash = range.find('-');
+      int first = std::atoi(range.c_str());
+      int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+      for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+  }
+
+  const NumaTopology& NumaTopology::system() {
+    static const NumaTopology topology = []() {
+      NumaTopology t;
+      // Stop at the first missing node id
+      for (int node = 0;; node++) {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!in) break;
+        std::string text;
+        std::getline(in, text);
+        t.node_cpus.push_back(parse_cpulist(text));
+      }
+      if (t.node_cpus.size() < 2) t.node_cpus.clear();
+      return t;
+    }();
+    return topology;
+  }
+
+  bool numa_bind_thread(const NumaTopology& topology, int node) {
+    current_node = node;
+    if (node < 0 || node >= static_cast<int>(topology.node_cpus.size())) return false;
+    const std::vector<int>& cpus = topology.node_cpus[node];
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+  }
+
+  int numa_current_node() {
+    return current_node;
+  }
+
+} // namespace fresub
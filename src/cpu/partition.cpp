@@ -0,0 +1,164 @@
+#include "partition.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+
+#include "aig_utils.hpp"
+#include "parallel.hpp"
+
+namespace fresub {
+
+  static int map_lit(const std::vector<int>& m, int lit) {
+    assert(m[lit2var(lit)] >= 0);
+    return m[lit2var(lit)] ^ (lit & 1);
+  }
+
+  // Append the PO cones of src to dst in topological order. m maps src nodes
+  // to dst literals; the constant and the PIs must be mapped by the caller.
+  static void copy_cones(const aigman& src, aigman& dst, std::vector<int>& m) {
+    std::vector<int> stack;
+    for (int po : src.vPos) {
+      stack.push_back(lit2var(po));
+      while (!stack.empty()) {
+        int node = stack.back();
+        if (m[node] >= 0) {
+          stack.pop_back();
+          continue;
+        }
+        int fanin0 = lit2var(src.vObjs[node * 2]);
+        int fanin1 = lit2var(src.vObjs[node * 2 + 1]);
+        if (m[fanin0] < 0) {
+          stack.push_back(fanin0);
+        } else if (m[fanin1] < 0) {
+          stack.push_back(fanin1);
+        } else {
+          stack.pop_back();
+          m[node] = var2lit(dst.newgate(map_lit(m, src.vObjs[node * 2]), map_lit(m, src.vObjs[node * 2 + 1])));
+        }
+      }
+    }
+  }
+
+  std::vector<Partition> partition_aig(const aigman& aig, int max_gates, PartitionMode mode) {
+    assert(aig.fSorted && max_gates > 0);
+    std::vector<int> region(aig.nObjs, -1);
+    std::vector<Partition> parts;
+    auto assign = [&](int gate) {
+      if (parts.empty() || static_cast<int>(parts.back().gates.size()) >= max_gates) parts.emplace_back();
+      region[gate] = static_cast<int>(parts.size()) - 1;
+      parts.back().gates.push_back(gate);
+    };
+
+    if (mode == PartitionMode::LEVELS) {
+      std::vector<int> levels = compute_levels(aig);
+      std::vector<int> order;
+      for (int node = aig.nPis + 1; node < aig.nObjs; node++) order.push_back(node);
+      std::stable_sort(order.begin(), order.end(), [&levels](int a, int b) { return levels[a] < levels[b]; });
+      for (int gate : order) assign(gate);
+    } else {
+      // Post-order DFS: fanins land in the same or an earlier region
+      std::vector<int> stack;
+      for (int po : aig.vPos) {
+        stack.push_back(lit2var(po));
+        while (!stack.empty()) {
+          int node = stack.back();
+          if (node <= aig.nPis || region[node] >= 0) {
+            stack.pop_back();
+            continue;
+          }
+          int fanin0 = lit2var(aig.vObjs[node * 2]);
+          int fanin1 = lit2var(aig.vObjs[node * 2 + 1]);
+          if (fanin0 > aig.nPis && region[fanin0] < 0) {
+            stack.push_back(fanin0);
+          } else if (fanin1 > aig.nPis && region[fanin1] < 0) {
+            stack.push_back(fanin1);
+          } else {
+            stack.pop_back();
+            assign(node);
+          }
+        }
+      }
+    }
+
+    // Boundaries: fanins from other regions are inputs; gates feeding other
+    // regions or POs are outputs
+    std::vector<char> is_output(aig.nObjs, 0);
+    for (int po : aig.vPos) is_output[lit2var(po)] = 1;
+    std::vector<int> seen(aig.nObjs, -1);
+    for (int r = 0; r < static_cast<int>(parts.size()); r++) {
+      auto& part = parts[r];
+      for (int gate : part.gates) {
+        for (int j = 0; j < 2; j++) {
+          int fanin = lit2var(aig.vObjs[gate * 2 + j]);
+          if (fanin == 0 || region[fanin] == r) continue;
+          if (region[fanin] >= 0) is_output[fanin] = 1;
+          if (seen[fanin] != r) {
+            seen[fanin] = r;
+            part.inputs.push_back(fanin);
+          }
+        }
+      }
+    }
+    for (auto& part : parts) {
+      for (int gate : part.gates) {
+        if (is_output[gate]) part.outputs.push_back(gate);
+      }
+    }
+    return parts;
+  }
+
+  aigman* extract_partition(const aigman& aig, const Partition& part) {
+    aigman* sub = new aigman(static_cast<int>(part.inputs.size()), static_cast<int>(part.outputs.size()));
+    std::unordered_map<int, int> m;  // global node -> sub literal
+    m[0] = 0;
+    for (size_t i = 0; i < part.inputs.size(); i++) m[part.inputs[i]] = var2lit(static_cast<int>(i) + 1);
+    auto sub_lit = [&m](int lit) { return m.at(lit2var(lit)) ^ (lit & 1); };
+    for (int gate : part.gates) {
+      m[gate] = var2lit(sub->newgate(sub_lit(aig.vObjs[gate * 2]), sub_lit(aig.vObjs[gate * 2 + 1])));
+    }
+    for (size_t k = 0; k < part.outputs.size(); k++) sub->vPos[k] = m.at(part.outputs[k]);
+    sub->fSorted = true;
+    return sub;
+  }
+
+  void stitch_partitions(aigman& aig, const std::vector<Partition>& parts, const std::vector<aigman*>& subs) {
+    assert(parts.size() == subs.size());
+    aigman stitched(aig.nPis, aig.nPos);
+    std::vector<int> lits(aig.nObjs, -1);  // global node -> stitched literal
+    lits[0] = 0;
+    for (int i = 1; i <= aig.nPis; i++) lits[i] = var2lit(i);
+    for (size_t r = 0; r < parts.size(); r++) {
+      const aigman& sub = *subs[r];
+      std::vector<int> m(sub.nObjs, -1);
+      m[0] = 0;
+      for (size_t i = 0; i < parts[r].inputs.size(); i++) m[i + 1] = lits[parts[r].inputs[i]];
+      copy_cones(sub, stitched, m);
+      for (size_t k = 0; k < parts[r].outputs.size(); k++) lits[parts[r].outputs[k]] = map_lit(m, sub.vPos[k]);
+    }
+    for (int i = 0; i < aig.nPos; i++) stitched.vPos[i] = map_lit(lits, aig.vPos[i]);
+
+    // Region outputs whose users were optimized away leave dangling logic
+    aigman result(aig.nPis, aig.nPos);
+    std::vector<int> m(stitched.nObjs, -1);
+    m[0] = 0;
+    for (int i = 1; i <= aig.nPis; i++) m[i] = var2lit(i);
+    copy_cones(stitched, result, m);
+    for (int i = 0; i < aig.nPos; i++) result.vPos[i] = map_lit(m, stitched.vPos[i]);
+    result.fSorted = true;
+    aig = std::move(result);
+  }
+
+  int optimize_partitioned(aigman& aig, int max_gates, PartitionMode mode, int num_threads, const PartitionOptimizer& optimize) {
+    std::vector<Partition> parts = partition_aig(aig, max_gates, mode);
+    std::vector<aigman*> subs(parts.size(), nullptr);
+    parallel_for(0, static_cast<int>(parts.size()), num_threads, [&](int r) {
+      subs[r] = extract_partition(aig, parts[r]);
+      optimize(*subs[r]);
+    });
+    stitch_partitions(aig, parts, subs);
+    for (aigman* sub : subs) delete sub;
+    return static_cast<int>(parts.size());
+  }
+
+} // namespace fresub
@@ -3,21 +3,47 @@
 #include <algorithm>
 #include <cassert>
 #include <iostream>
-#include <unordered_map>
+#include <map>
 #include "aig_utils.hpp"
 
 namespace fresub {
   
   // Use lit helpers from aig_utils.hpp
   
-  std::vector<std::vector<uint64_t>> compute_truth_tables_for_window(aigman const& aig, Window const& window, bool verbose) {
-
+  // Truth table of window input `i` over all 2^n window patterns
+  static void simulate_input(int i, int num_words, uint64_t* tt) {
     static const unsigned long long basepats[] = {0xaaaaaaaaaaaaaaaaull,
 	0xccccccccccccccccull,
 	0xf0f0f0f0f0f0f0f0ull,
 	0xff00ff00ff00ff00ull,
 	0xffff0000ffff0000ull,
 	0xffffffff00000000ull};
+    if(i < 6) {
+      for(int j = 0; j < num_words; j++) {
+	tt[j] = basepats[i];
+      }
+    } else {
+      for(int j = 0; j < num_words; j++) {
+	tt[j] = (j >> (i - 6)) & 1? 0xffffffffffffffffull: 0ull;
+      }
+    }
+  }
+
+  // Row `id` of the flat buffer `tts` = AND of its (possibly complemented) fanin rows
+  static void simulate_node(const WindowSnapshot& local, int id, int num_words, uint64_t* tts) {
+    int lit0 = local.fanins[id * 2];
+    int lit1 = local.fanins[id * 2 + 1];
+    uint64_t mask0 = is_complemented(lit0) ? ~0ull : 0ull;
+    uint64_t mask1 = is_complemented(lit1) ? ~0ull : 0ull;
+    const uint64_t* tt0 = tts + static_cast<size_t>(lit2var(lit0)) * num_words;
+    const uint64_t* tt1 = tts + static_cast<size_t>(lit2var(lit1)) * num_words;
+    uint64_t* tt = tts + static_cast<size_t>(id) * num_words;
+    for (int w = 0; w < num_words; w++) {
+      tt[w] = (tt0[w] ^ mask0) & (tt1[w] ^ mask1);
+    }
+  }
+
+  std::vector<std::vector<uint64_t>> compute_truth_tables_for_window(aigman const& aig, Window const& window, bool verbose) {
 
     if (verbose) {
       std::cout << "\n--- COMPUTING TRUTH TABLES FOR WINDOW ---\n";
@@ -48,28 +74,34 @@ namespace fresub {
       std::cout << "Truth table size: " << num_patterns << " patterns = " << num_words << " words of 64 bits\n";
     }
     
-    std::unordered_map<int, std::vector<uint64_t>> node_tt;
+    // Simulate on the window-local snapshot; hand-built windows get one on the fly
+    WindowSnapshot scratch;
+    const WindowSnapshot* local = &window.local;
+    if (local->fanins.empty() || local->divisors.size() != window.divisors.size()) {
+      Window copy;
+      copy.target_node = window.target_node;
+      copy.inputs = window.inputs;
+      copy.nodes = window.nodes;
+      copy.divisors = window.divisors;
+      build_window_snapshot(aig, copy);
+      scratch = std::move(copy.local);
+      local = &scratch;
+    }
+    int num_nodes = static_cast<int>(window.nodes.size());
+    std::vector<uint64_t> tts(static_cast<size_t>(num_nodes) * num_words);
+    auto row = [&](int id) { return tts.data() + static_cast<size_t>(id) * num_words; };
 
     if (verbose) std::cout << "Initializing primary input truth tables:\n";
     for(int i = 0; i < num_inputs; i++) {
-      int wi = window.inputs[i];
-      node_tt[wi].resize(num_words);
-      if(i < 6) {
-	for(int j = 0; j < num_words; j++) {
-	  node_tt[wi][j] = basepats[i];
-	}
-      } else {
-	for(int j = 0; j < num_words; j++) {
-	  node_tt[wi][j] = (j >> (i - 6)) & 1? 0xffffffffffffffffull: 0ull;
-	}
-      }
+      uint64_t* tt = row(local->inputs[i]);
+      simulate_input(i, num_words, tt);
       if (verbose) {
-	std::cout << "  Input " << wi << " (position " << i << "): ";
+	std::cout << "  Input " << window.inputs[i] << " (position " << i << "): ";
 	if (num_patterns <= 64) {
 	  for (int b = num_patterns - 1; b >= 0; b--) {
-	    std::cout << ((node_tt[wi][0] >> b) & 1);
+	    std::cout << ((tt[0] >> b) & 1);
 	  }
-	  std::cout << " (0x" << std::hex << node_tt[wi][0] << std::dec << ")";
+	  std::cout << " (0x" << std::hex << tt[0] << std::dec << ")";
 	} else {
 	  std::cout << "[" << num_words << " words, " << num_patterns << " patterns]";
 	}
@@ -78,30 +110,26 @@ namespace fresub {
     }
       
     if (verbose) std::cout << "\nProcessing window nodes:\n";
-    for (int current_node : window.nodes) {
-      if (std::find(window.inputs.begin(), window.inputs.end(), current_node) != window.inputs.end()) {
+    for (int id = 0; id < num_nodes; id++) {
+      if (local->flags[id] & WindowSnapshot::INPUT) {
 	continue; // Skip inputs, already processed
       }
-      int fanin0 = lit2var(aig.vObjs[current_node * 2]);
-      int fanin1 = lit2var(aig.vObjs[current_node * 2 + 1]);
-      bool comp0 = is_complemented(aig.vObjs[current_node * 2]);
-      bool comp1 = is_complemented(aig.vObjs[current_node * 2 + 1]);
-      node_tt[current_node].resize(num_words);
-      for (int w = 0; w < num_words; w++) {
-	uint64_t val0 = comp0 ? ~node_tt[fanin0][w] : node_tt[fanin0][w];
-	uint64_t val1 = comp1 ? ~node_tt[fanin1][w] : node_tt[fanin1][w];
-	node_tt[current_node][w] = val0 & val1;
-      }
+      simulate_node(*local, id, num_words, tts.data());
       if (verbose) {
-	std::cout << "  Node " << current_node << " = AND(";
-	std::cout << fanin0 << (comp0 ? "'" : "") << ", ";
-	std::cout << fanin1 << (comp1 ? "'" : "") << "):\n";
+	int fanin0 = lit2var(local->fanins[id * 2]);
+	int fanin1 = lit2var(local->fanins[id * 2 + 1]);
+	bool mask0 = is_complemented(local->fanins[id * 2]);
+	bool mask1 = is_complemented(local->fanins[id * 2 + 1]);
+	const uint64_t* tt = row(id);
+	std::cout << "  Node " << window.nodes[id] << " = AND(";
+	std::cout << window.nodes[fanin0] << (mask0 ? "'" : "") << ", ";
+	std::cout << window.nodes[fanin1] << (mask1 ? "'" : "") << "):\n";
 	if (num_patterns <= 64) {
 	  std::cout << "    ";
 	  for (int b = num_patterns - 1; b >= 0; b--) {
-	    std::cout << ((node_tt[current_node][0] >> b) & 1);
+	    std::cout << ((tt[0] >> b) & 1);
 	  }
-	  std::cout << " (0x" << std::hex << node_tt[current_node][0] << std::dec << ")";
+	  std::cout << " (0x" << std::hex << tt[0] << std::dec << ")";
 	} else {
 	  std::cout << "    [" << num_words << " words computed]";
 	}
@@ -112,12 +140,11 @@ namespace fresub {
     // Extract results as vector<vector<word>>
     // results[0..n-1] = divisors[0..n-1], results[n] = target
     std::vector<std::vector<uint64_t>> results;
-    for (int divisor : window.divisors) {
-      assert(node_tt.find(divisor) != node_tt.end());
-      results.push_back(std::move(node_tt[divisor]));
+    results.reserve(local->divisors.size() + 1);
+    for (int id : local->divisors) {
+      results.emplace_back(row(id), row(id) + num_words);
     }
-    assert(node_tt.find(window.target_node) != node_tt.end());
-    results.push_back(std::move(node_tt[window.target_node]));
+    results.emplace_back(row(local->target), row(local->target) + num_words);
     if (verbose) {
       std::cout << "\nExtracted truth tables as vector<vector<word>>:\n";
       for (size_t i = 0; i < window.divisors.size(); i++) {
@@ -132,4 +159,251 @@ namespace fresub {
     return results;
   }
 
+  void compute_window_care(Window& window, int max_depth) {
+    auto& local = window.local;
+    window.care.clear();
+    if (max_depth <= 0) return;
+    assert(!local.fanins.empty() && "window_analyze_all must run before ODC");
+    int n = static_cast<int>(local.flags.size());
+    int num_inputs = static_cast<int>(local.inputs.size());
+    int num_words = ((1 << num_inputs) + 63) / 64;
+
+    // Longest-path depth from the target along its TFO; -1 outside the resimulated region
+    std::vector<int> depth(n, -1);
+    depth[local.target] = 0;
+    for (int id = local.target + 1; id < n; id++) {
+      if (!(local.flags[id] & WindowSnapshot::TFO)) continue;
+      bool inside = true;
+      for (int k = 0; k < 2; k++) {
+        int fi = lit2var(local.fanins[id * 2 + k]);
+        if (depth[fi] >= 0) {
+          depth[id] = std::max(depth[id], depth[fi] + 1);
+        } else if (local.flags[fi] & WindowSnapshot::TFO) {
+          inside = false;  // fanin changes but is not resimulated
+        }
+      }
+      if (!inside || depth[id] > max_depth) depth[id] = -1;
+    }
+
+    // Simulate the window, then again with the target flipped over the region
+    std::vector<uint64_t> tts(static_cast<size_t>(n) * num_words);
+    for (int i = 0; i < num_inputs; i++) {
+      simulate_input(i, num_words, tts.data() + static_cast<size_t>(local.inputs[i]) * num_words);
+    }
+    for (int id = 0; id < n; id++) {
+      if (local.flags[id] & WindowSnapshot::INPUT) continue;
+      simulate_node(local, id, num_words, tts.data());
+    }
+    std::vector<uint64_t> flipped = tts;
+    for (int w = 0; w < num_words; w++) {
+      flipped[static_cast<size_t>(local.target) * num_words + w] ^= ~0ull;
+    }
+    for (int id = local.target + 1; id < n; id++) {
+      if (depth[id] > 0) simulate_node(local, id, num_words, flipped.data());
+    }
+
+    // Observation points: region nodes with fanouts outside the window (incl.
+    // POs) or beyond the depth limit. A pattern is care if any of them changes.
+    std::vector<uint64_t> care(num_words, 0);
+    std::vector<char> root(n, 0);
+    for (int id = local.target; id < n; id++) {
+      if (depth[id] < 0) continue;
+      int local_fanouts = local.fanout_offsets[id + 1] - local.fanout_offsets[id];
+      root[id] = local.refs[id] > local_fanouts;
+      for (int o = local.fanout_offsets[id]; o < local.fanout_offsets[id + 1] && !root[id]; o++) {
+        if (depth[local.fanout_indices[o]] < 0) root[id] = 1;
+      }
+      if (!root[id]) continue;
+      const uint64_t* a = tts.data() + static_cast<size_t>(id) * num_words;
+      const uint64_t* b = flipped.data() + static_cast<size_t>(id) * num_words;
+      for (int w = 0; w < num_words; w++) care[w] |= a[w] ^ b[w];
+    }
+    if (std::all_of(care.begin(), care.end(), [](uint64_t w) { return w == ~0ull; })) {
+      return;  // fully observable: exact resubstitution
+    }
+    for (int id = local.target; id < n; id++) {
+      if (depth[id] >= 0 && !root[id]) local.flags[id] |= WindowSnapshot::ODC;
+    }
+    window.care = std::move(care);
+  }
+
+  static uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  std::vector<uint64_t> simulate_aig_random(aigman const& aig, int num_words, uint64_t seed) {
+    assert(aig.fSorted);
+    std::vector<uint64_t> sims(static_cast<size_t>(aig.nObjs) * num_words, 0);
+    for (int i = 1; i <= aig.nPis; i++) {
+      uint64_t* tt = sims.data() + static_cast<size_t>(i) * num_words;
+      for (int w = 0; w < num_words; w++) {
+        uint64_t a = splitmix64(seed);
+        switch (w % 4) {
+        case 2: tt[w] = a & splitmix64(seed); break;   // biased to 0
+        case 3: tt[w] = a | splitmix64(seed); break;   // biased to 1
+        default: tt[w] = a; break;
+        }
+      }
+    }
+    for (int i = aig.nPis + 1; i < aig.nObjs; i++) {
+      if (!is_node_accessible(aig, i)) continue;
+      int lit0 = aig.vObjs[i * 2];
+      int lit1 = aig.vObjs[i * 2 + 1];
+      uint64_t mask0 = is_complemented(lit0) ? ~0ull : 0ull;
+      uint64_t mask1 = is_complemented(lit1) ? ~0ull : 0ull;
+      const uint64_t* tt0 = sims.data() + static_cast<size_t>(lit2var(lit0)) * num_words;
+      const uint64_t* tt1 = sims.data() + static_cast<size_t>(lit2var(lit1)) * num_words;
+      uint64_t* tt = sims.data() + static_cast<size_t>(i) * num_words;
+      for (int w = 0; w < num_words; w++) {
+        tt[w] = (tt0[w] ^ mask0) & (tt1[w] ^ mask1);
+      }
+    }
+    return sims;
+  }
+
+  // Mark in `seen` (bit m <=> leaf values m, leaf i at bit i) every combination
+  // that occurs in some pattern of the leaf rows; returns the number of new ones
+  static int collect_leaf_combinations(const std::vector<const uint64_t*>& leaves, int num_words, std::vector<char>& seen) {
+    int k = static_cast<int>(leaves.size());
+    int found = 0;
+    for (int m = 0; m < (1 << k); m++) {
+      if (seen[m]) continue;
+      for (int w = 0; w < num_words; w++) {
+        uint64_t acc = ~0ull;
+        for (int i = 0; i < k && acc; i++) {
+          acc &= (m >> i) & 1 ? leaves[i][w] : ~leaves[i][w];
+        }
+        if (acc) {
+          seen[m] = 1;
+          found++;
+          break;
+        }
+      }
+    }
+    return found;
+  }
+
+  // Per-node buffers shared by the exact_leaf_combinations calls of one pass.
+  // A node's entries are valid only if its stamp equals the current epoch, so
+  // nothing of size nObjs is cleared per leaf set.
+  struct ExactScratch {
+    std::vector<uint32_t> stamp;
+    std::vector<int> row;  // truth-table row of a stamped node
+    uint32_t epoch = 0;
+    std::vector<int> cone, support, stack;
+    std::vector<uint64_t> tts;
+  };
+
+  // Exact leaf combinations by exhaustive simulation of the leaves' TFI.
+  // Returns false if the PI support exceeds max_support.
+  static bool exact_leaf_combinations(aigman const& aig, const std::vector<int>& leaves, int max_support, std::vector<char>& seen,
+                                      ExactScratch& scratch) {
+    if (scratch.stamp.size() < static_cast<size_t>(aig.nObjs)) {
+      scratch.stamp.assign(aig.nObjs, 0);
+      scratch.row.resize(aig.nObjs);
+      scratch.epoch = 0;
+    }
+    uint32_t epoch = ++scratch.epoch;
+    std::vector<uint32_t>& stamp = scratch.stamp;
+    std::vector<int>& row = scratch.row;
+    // TFI of the leaves in topological (id) order
+    std::vector<int>& cone = scratch.cone;
+    std::vector<int>& support = scratch.support;
+    std::vector<int>& stack = scratch.stack;
+    cone.clear();
+    support.clear();
+    stack.assign(leaves.begin(), leaves.end());
+    while (!stack.empty()) {
+      int n = stack.back();
+      stack.pop_back();
+      if (n == 0 || stamp[n] == epoch) continue;
+      stamp[n] = epoch;
+      if (n <= aig.nPis) {
+        support.push_back(n);
+        if (static_cast<int>(support.size()) > max_support) return false;
+        continue;
+      }
+      cone.push_back(n);
+      stack.push_back(lit2var(aig.vObjs[n * 2]));
+      stack.push_back(lit2var(aig.vObjs[n * 2 + 1]));
+    }
+    std::sort(cone.begin(), cone.end());
+    std::sort(support.begin(), support.end());
+
+    int num_words = ((1 << support.size()) + 63) / 64;
+    std::vector<uint64_t>& tts = scratch.tts;
+    tts.assign(static_cast<size_t>(support.size() + cone.size() + 1) * num_words, 0);
+    int next = 1;  // row 0: constant 0
+    row[0] = 0;
+    for (size_t i = 0; i < support.size(); i++) {
+      row[support[i]] = next;
+      simulate_input(static_cast<int>(i), num_words, tts.data() + static_cast<size_t>(next++) * num_words);
+    }
+    for (int n : cone) {
+      row[n] = next++;
+      int lit0 = aig.vObjs[n * 2];
+      int lit1 = aig.vObjs[n * 2 + 1];
+      uint64_t mask0 = is_complemented(lit0) ? ~0ull : 0ull;
+      uint64_t mask1 = is_complemented(lit1) ? ~0ull : 0ull;
+      const uint64_t* tt0 = tts.data() + static_cast<size_t>(row[lit2var(lit0)]) * num_words;
+      const uint64_t* tt1 = tts.data() + static_cast<size_t>(row[lit2var(lit1)]) * num_words;
+      uint64_t* tt = tts.data() + static_cast<size_t>(row[n]) * num_words;
+      for (int w = 0; w < num_words; w++) {
+        tt[w] = (tt0[w] ^ mask0) & (tt1[w] ^ mask1);
+      }
+    }
+    std::vector<const uint64_t*> leaf_rows;
+    for (int leaf : leaves) leaf_rows.push_back(tts.data() + static_cast<size_t>(row[leaf]) * num_words);
+    std::fill(seen.begin(), seen.end(), 0);
+    collect_leaf_combinations(leaf_rows, num_words, seen);
+    return true;
+  }
+
+  SdcStats compute_window_sdc(aigman const& aig, std::vector<Window>& windows, int num_words, int max_support) {
+    SdcStats stats;
+    std::vector<uint64_t> sims = simulate_aig_random(aig, num_words, 0x5dc);
+    // Exhaustive results per leaf set (empty = support too large)
+    std::map<std::vector<int>, std::vector<char>> exact;
+    ExactScratch scratch;
+    std::vector<const uint64_t*> leaf_rows;
+    for (auto& window : windows) {
+      int k = static_cast<int>(window.inputs.size());
+      if (k == 0 || k > 16) continue;
+      std::vector<char> seen(1 << k, 0);
+      leaf_rows.clear();
+      for (int leaf : window.inputs) leaf_rows.push_back(sims.data() + static_cast<size_t>(leaf) * num_words);
+      if (collect_leaf_combinations(leaf_rows, num_words, seen) == (1 << k)) continue;
+
+      auto it = exact.find(window.inputs);
+      if (it == exact.end()) {
+        std::vector<char> combos(1 << k, 0);
+        if (!exact_leaf_combinations(aig, window.inputs, max_support, combos, scratch)) combos.clear();
+        it = exact.emplace(window.inputs, std::move(combos)).first;
+      }
+      if (it->second.empty()) {
+        stats.unconfirmed++;
+        continue;
+      }
+      const std::vector<char>& possible = it->second;
+      if (std::all_of(possible.begin(), possible.end(), [](char c) { return c != 0; })) continue;
+
+      // Care bits in truth-table layout (patterns repeat within a word for k < 6)
+      int tt_words = ((1 << k) + 63) / 64;
+      std::vector<uint64_t> care(tt_words, 0);
+      for (int b = 0; b < tt_words * 64; b++) {
+        if (possible[b & ((1 << k) - 1)]) care[b >> 6] |= 1ull << (b & 63);
+      }
+      if (window.care.empty()) {
+        window.care = std::move(care);
+      } else {
+        for (int w = 0; w < tt_words; w++) window.care[w] &= care[w];
+      }
+      stats.windows_with_sdc++;
+    }
+    return stats;
+  }
+
 } // namespace fresub
@@ -0,0 +1,179 @@
+#include "spill.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "candidates.hpp"
+
+namespace fresub {
+
+  // Segment layout:
+  //   u64 structure_bytes, u32 n_windows, n_windows x window, candidate records
+  //   window: i32 target_node, cut_id, mffc_size, numa_node, local.target,
+  //           then vectors as u32 size + elements: inputs, nodes, divisors,
+  //           care, local.fanins, fanout_offsets, fanout_indices, refs, flags,
+  //           inputs, divisors, mffc_below
+
+  template <typename T>
+  static void put(std::vector<unsigned char>& out, T v) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&v);
+    out.insert(out.end(), p, p + sizeof(T));
+  }
+
+  template <typename T>
+  static void put_vector(std::vector<unsigned char>& out, const std::vector<T>& v) {
+    put<uint32_t>(out, v.size());
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(v.data());
+    out.insert(out.end(), p, p + v.size() * sizeof(T));
+  }
+
+  template <typename T>
+  static bool get(const unsigned char*& p, const unsigned char* end, T& v) {
+    if (static_cast<size_t>(end - p) < sizeof(T)) return false;
+    std::memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+  }
+
+  template <typename T>
+  static bool get_vector(const unsigned char*& p, const unsigned char* end, std::vector<T>& v) {
+    uint32_t n;
+    if (!get(p, end, n) || n > static_cast<size_t>(end - p) / sizeof(T)) return false;
+    v.resize(n);
+    if (n) std::memcpy(v.data(), p, n * sizeof(T));
+    p += n * sizeof(T);
+    return true;
+  }
+
+  static void encode_window(const Window& window, std::vector<unsigned char>& out) {
+    put<int32_t>(out, window.target_node);
+    put<int32_t>(out, window.cut_id);
+    put<int32_t>(out, window.mffc_size);
+    put<int32_t>(out, window.numa_node);
+    put<int32_t>(out, window.local.target);
+    put_vector(out, window.inputs);
+    put_vector(out, window.nodes);
+    put_vector(out, window.divisors);
+    put_vector(out, window.care);
+    put_vector(out, window.local.fanins);
+    put_vector(out, window.local.fanout_offsets);
+    put_vector(out, window.local.fanout_indices);
+    put_vector(out, window.local.refs);
+    put_vector(out, window.local.flags);
+    put_vector(out, window.local.inputs);
+    put_vector(out, window.local.divisors);
+    put_vector(out, window.local.mffc_below);
+  }
+
+  static bool decode_window(const unsigned char*& p, const unsigned char* end, Window& window) {
+    int32_t target_node, cut_id, mffc_size, numa_node, target;
+    if (!get(p, end, target_node) || !get(p, end, cut_id) || !get(p, end, mffc_size) || !get(p, end, numa_node) ||
+        !get(p, end, target)) {
+      return false;
+    }
+    window.target_node = target_node;
+    window.cut_id = cut_id;
+    window.mffc_size = mffc_size;
+    window.numa_node = numa_node;
+    window.local.target = target;
+    return get_vector(p, end, window.inputs) && get_vector(p, end, window.nodes) &&
+           get_vector(p, end, window.divisors) && get_vector(p, end, window.care) &&
+           get_vector(p, end, window.local.fanins) && get_vector(p, end, window.local.fanout_offsets) &&
+           get_vector(p, end, window.local.fanout_indices) && get_vector(p, end, window.local.refs) &&
+           get_vector(p, end, window.local.flags) && get_vector(p, end, window.local.inputs) &&
+           get_vector(p, end, window.local.divisors) && get_vector(p, end, window.local.mffc_below);
+  }
+
+  SpillFile::~SpillFile() {
+    if (fd >= 0) close(fd);
+  }
+
+  bool SpillFile::open(const std::string& dir) {
+    assert(fd < 0);
+    std::string path = (dir.empty() ? std::string(".") : dir) + "/fresub-spill-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    fd = mkstemp(name.data());
+    if (fd < 0) {
+      std::cerr << "Error: cannot create spill file in " << dir << ": " << std::strerror(errno) << "\n";
+      return false;
+    }
+    // Unlinked right away: the space is returned when the file is closed
+    unlink(name.data());
+    return true;
+  }
+
+  bool SpillFile::append(std::vector<Window>::const_iterator begin, std::vector<Window>::const_iterator end,
+                         Segment& segment) {
+    assert(fd >= 0);
+    buffer.clear();
+    put<uint64_t>(buffer, 0);
+    put<uint32_t>(buffer, std::distance(begin, end));
+    for (auto it = begin; it != end; ++it) encode_window(*it, buffer);
+    uint64_t structure_bytes = buffer.size() - sizeof(uint64_t);
+    std::memcpy(buffer.data(), &structure_bytes, sizeof(structure_bytes));
+    encode_candidate_records(begin, end, buffer);
+
+    segment.offset = file_size;
+    segment.size = buffer.size();
+    const unsigned char* p = buffer.data();
+    size_t n = buffer.size();
+    while (n > 0) {
+      ssize_t w = pwrite(fd, p, std::min(n, CHUNK_BYTES), file_size);
+      if (w <= 0) {
+        std::cerr << "Error: cannot write spill file: " << std::strerror(errno) << "\n";
+        return false;
+      }
+      p += w;
+      n -= w;
+      file_size += w;
+    }
+    return true;
+  }
+
+  int SpillFile::load(const Segment& segment, std::vector<Window>& windows) {
+    assert(fd >= 0 && segment.offset + segment.size <= file_size);
+    // Map just this segment; the mapping must start on a page boundary
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t map_offset = segment.offset / page * page;
+    size_t map_size = segment.offset - map_offset + segment.size;
+    void* mapped = map_size ? mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, map_offset) : nullptr;
+    if (mapped == MAP_FAILED) {
+      std::cerr << "Error: cannot map spill file: " << std::strerror(errno) << "\n";
+      return -1;
+    }
+    madvise(mapped, map_size, MADV_SEQUENTIAL);
+
+    // Decode into a separate list so candidate records only search this segment
+    const unsigned char* p = static_cast<const unsigned char*>(mapped) + (segment.offset - map_offset);
+    const unsigned char* end = p + segment.size;
+    uint64_t structure_bytes;
+    uint32_t n_windows;
+    std::vector<Window> loaded;
+    bool ok = get(p, end, structure_bytes) && structure_bytes <= static_cast<size_t>(end - p) &&
+              get(p, end, n_windows) && n_windows <= structure_bytes;
+    if (ok) loaded.resize(n_windows);
+    for (uint32_t i = 0; ok && i < n_windows; i++) ok = decode_window(p, end, loaded[i]);
+    int count = ok ? decode_candidate_records(p, end - p, loaded) : -1;
+    if (mapped) munmap(mapped, map_size);
+    if (count < 0) {
+      for (auto& window : loaded) {
+        for (auto& fs : window.feasible_sets) delete fs.synth;
+      }
+      std::cerr << "Error: spill file is corrupt\n";
+      return -1;
+    }
+    windows.insert(windows.end(), std::make_move_iterator(loaded.begin()), std::make_move_iterator(loaded.end()));
+    return count;
+  }
+
+} // namespace fresub
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <cassert>
+#include <mutex>
 
 #include <kissat_solver.hpp>
 #include <synth.hpp>
@@ -18,7 +19,8 @@ using namespace std;
 namespace fresub {
 
   // Convert truth tables to exopt binary relation format
-  void generate_relation(const vector<vector<uint64_t>>& truth_tables, const vector<int>& selected_divisors, int num_inputs, vector<vector<bool>>& br) {
+  template <typename Indices>
+  static void generate_relation_impl(const TruthTables& truth_tables, const Indices& selected_divisors, int num_inputs, vector<vector<bool>>& br, const uint64_t* care) {
     // We compute target function in terms of selected divisors
     // br[divisor_pattern][target_value] = can this divisor pattern produce this target value?
     // Initialize with all true (everything is don't care initially)
@@ -32,6 +34,8 @@ namespace fresub {
     for (int input_pattern = 0; input_pattern < total_patterns; input_pattern++) {
       int word_idx = input_pattern / 64;
       int bit_idx = input_pattern % 64;
+      // Observability don't-care: either target value is allowed
+      if (care && !((care[word_idx] >> bit_idx) & 1)) continue;
       // Extract target value for this input pattern
       bool target_value = (truth_tables.back()[word_idx] >> bit_idx) & 1;
       // Extract selected divisor values for this input pattern
@@ -48,6 +52,14 @@ namespace fresub {
     }
   }
   
+  void generate_relation(const TruthTables& truth_tables, const vector<int>& selected_divisors, int num_inputs, vector<vector<bool>>& br, const uint64_t* care) {
+    generate_relation_impl(truth_tables, selected_divisors, num_inputs, br, care);
+  }
+
+  void generate_relation(const TruthTables& truth_tables, const DivisorIndices& selected_divisors, int num_inputs, vector<vector<bool>>& br, const uint64_t* care) {
+    generate_relation_impl(truth_tables, selected_divisors, num_inputs, br, care);
+  }
+  
   aigman* synthesize_circuit(const vector<vector<bool>>& br, int max_gates) {
     // Create synthesis manager - pass NULL for sim since we don't use it
     SynthMan<KissatSolver> synth_man(br, nullptr);
@@ -82,6 +94,9 @@ namespace fresub {
         extended_truth_table |= (extended_truth_table << shift_amount);
       }
     }
+    // The library database is shared (topo_view marks its nodes); one caller at a time
+    static std::mutex library_mutex;
+    std::lock_guard<std::mutex> lock(library_mutex);
     // Get the static library instance
     auto& lib = get_mockturtle_library();
     // Create truth table object
@@ -0,0 +1,178 @@
+#include "truth_table_store.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+
+#include "numa.hpp"
+
+namespace fresub {
+
+  TruthTableStore& TruthTableStore::global() {
+    static TruthTableStore store;
+    return store;
+  }
+
+  uint64_t TruthTableStore::hash_words(const uint64_t* words, uint32_t num_words) {
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ num_words;
+    for (uint32_t w = 0; w < num_words; w++) {
+      h ^= words[w] + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+      h *= 0xff51afd7ed558ccdull;
+    }
+    return h ^ (h >> 29);
+  }
+
+  uint64_t* TruthTableStore::allocate(Shard& shard, uint32_t num_words, int node) {
+    auto it = shard.free_rows.find((uint64_t(node) << 32) | num_words);
+    if (it != shard.free_rows.end() && !it->second.empty()) {
+      uint64_t* row = it->second.back();
+      it->second.pop_back();
+      return row;
+    }
+    Chunk& chunk = shard.chunks[node];
+    size_t need = num_words + 3;
+    if (chunk.used + need > chunk.size) {
+      chunk.size = std::max(CHUNK_WORDS, need);
+      chunk.words = static_cast<uint64_t*>(arenas[node].allocate(chunk.size * sizeof(uint64_t)));
+      if (!chunk.words) throw std::bad_alloc();
+      chunk.used = 0;
+    }
+    uint64_t* row = chunk.words + chunk.used + 3;
+    chunk.used += need;
+    return row;
+  }
+
+  const uint64_t* TruthTableStore::intern(const uint64_t* words, uint32_t num_words) {
+    uint64_t hash = hash_words(words, num_words);
+    Shard& shard = shard_of(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.stats.interned++;
+    auto range = shard.index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      uint64_t* row = it->second;
+      if (row_size(row) != num_words || (num_words && std::memcmp(row, words, num_words * sizeof(uint64_t)) != 0)) continue;
+      row[-1]++;
+      shard.stats.shared++;
+      return row;
+    }
+    int node = numa_current_node() % MAX_NODES;
+    uint64_t* row = allocate(shard, num_words, node);
+    row[-3] = hash;
+    row[-2] = (uint64_t(node) << 32) | num_words;
+    row[-1] = 1;
+    if (num_words) std::memcpy(row, words, num_words * sizeof(uint64_t));
+    shard.index.emplace(hash, row);
+    shard.stats.rows++;
+    shard.stats.words += num_words;
+    return row;
+  }
+
+  void TruthTableStore::retain(const uint64_t* row) {
+    Shard& shard = shard_of(row[-3]);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const_cast<uint64_t*>(row)[-1]++;
+  }
+
+  void TruthTableStore::release(const uint64_t* row) {
+    uint64_t hash = row[-3];
+    Shard& shard = shard_of(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    uint64_t* mutable_row = const_cast<uint64_t*>(row);
+    assert(mutable_row[-1] > 0);
+    if (--mutable_row[-1] != 0) return;
+    auto range = shard.index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second != row) continue;
+      shard.index.erase(it);
+      break;
+    }
+    uint32_t num_words = row_size(row);
+    shard.free_rows[row[-2]].push_back(mutable_row);
+    shard.stats.rows--;
+    shard.stats.words -= num_words;
+  }
+
+  TruthTableStore::Stats TruthTableStore::stats() {
+    Stats total;
+    for (auto& shard : shards) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      total.rows += shard.stats.rows;
+      total.words += shard.stats.words;
+      total.interned += shard.stats.interned;
+      total.shared += shard.stats.shared;
+    }
+    return total;
+  }
+
+  HugePageArena::Stats TruthTableStore::arena_stats() {
+    HugePageArena::Stats total;
+    for (auto& arena : arenas) {
+      HugePageArena::Stats s = arena.stats();
+      total.bytes += s.bytes;
+      total.peak_bytes += s.peak_bytes;
+      total.huge_pages += s.huge_pages;
+      total.thp_pages += s.thp_pages;
+    }
+    return total;
+  }
+
+  bool TruthTableStore::release_memory() {
+    std::unique_lock<std::mutex> locks[NUM_SHARDS];
+    for (int i = 0; i < NUM_SHARDS; i++) locks[i] = std::unique_lock<std::mutex>(shards[i].mutex);
+    for (const auto& shard : shards) {
+      if (shard.stats.rows != 0) return false;
+    }
+    for (auto& shard : shards) {
+      shard.index.clear();
+      shard.free_rows.clear();
+      for (auto& chunk : shard.chunks) chunk = Chunk();
+    }
+    for (auto& arena : arenas) arena.reset();
+    return true;
+  }
+
+  bool TruthTableRow::operator<(const TruthTableRow& o) const {
+    return std::lexicographical_compare(begin(), end(), o.begin(), o.end());
+  }
+
+  TruthTables::TruthTables(std::initializer_list<std::vector<uint64_t>> tables) {
+    for (const auto& tt : tables) push_back(tt.data(), static_cast<uint32_t>(tt.size()));
+  }
+
+  TruthTables::TruthTables(const TruthTables& o) : rows(o.rows) {
+    for (const auto& row : rows) TruthTableStore::global().retain(row.data());
+  }
+
+  TruthTables& TruthTables::operator=(const TruthTables& o) {
+    if (this == &o) return *this;
+    for (const auto& row : o.rows) TruthTableStore::global().retain(row.data());
+    clear();
+    rows = o.rows;
+    return *this;
+  }
+
+  TruthTables& TruthTables::operator=(TruthTables&& o) noexcept {
+    if (this == &o) return *this;
+    clear();
+    rows = std::move(o.rows);
+    o.rows.clear();
+    return *this;
+  }
+
+  void TruthTables::assign(const std::vector<std::vector<uint64_t>>& tables) {
+    clear();
+    rows.reserve(tables.size());
+    for (const auto& tt : tables) push_back(tt.data(), static_cast<uint32_t>(tt.size()));
+  }
+
+  void TruthTables::push_back(const uint64_t* words, uint32_t num_words) {
+    rows.emplace_back(TruthTableStore::global().intern(words, num_words));
+  }
+
+  void TruthTables::clear() {
+    for (const auto& row : rows) TruthTableStore::global().release(row.data());
+    rows.clear();
+  }
+
+} // namespace fresub
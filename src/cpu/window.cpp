@@ -5,88 +5,209 @@
 #include <iostream>
 #include <queue>
 #include "aig_utils.hpp"
+#include "cut_enum.hpp"
+#include "parallel.hpp"
 
 namespace fresub {
 
 void window_extract_all(aigman& aig, int max_cut_size, bool verbose, std::vector<Window>& windows) {
-  assert(aig.fSorted);
-  windows.clear();
-
-  std::vector<std::vector<Cut>> cuts;
-
-  if (verbose) std::cout << "Enumerating cuts using exopt...\n";
-  CutEnumeration(aig, cuts, max_cut_size);
-
-  if (verbose) std::cout << "Creating windows from cuts...\n";
+  AigSnapshot snapshot;
+  build_aig_snapshot(aig, 1, snapshot);
+  window_enumerate_all(aig, snapshot, max_cut_size, verbose, windows);
+  window_analyze_all(snapshot, windows, 1);
+}
 
-  // Collect ALL cuts and assign global cut IDs
-  std::vector<std::pair<int, Cut*>> all_cuts; // (target_node, cut)
-  for (int target = aig.nPis + 1; target < aig.nObjs; target++) {
-    for (auto& cut : cuts[target]) {
-      if (cut.leaves.size() == 1 && cut.leaves[0] == target) {
-        continue; // Skip trivial cut
-      }
-      assert(cut.leaves.size() <= static_cast<size_t>(max_cut_size));
-      all_cuts.emplace_back(target, &cut);
-    }
+// Fill window.nodes of windows whose target_node and inputs are set: a node
+// is in a window if both its fanins are. Nodes below the smallest leaf are in
+// none.
+static void collect_window_nodes(const AigSnapshot& aig, std::vector<Window>& windows) {
+  if (windows.empty()) return;
+  int hi = aig.num_objs - 1;
+  int lo = hi;
+  for (const auto& window : windows) {
+    for (int leaf : window.inputs) lo = std::min(lo, leaf);
   }
-
-  // Create lists for each node to store cut IDs
-  std::vector<std::vector<int>> node_cut_lists(aig.nObjs);
-  for (size_t cut_id = 0; cut_id < all_cuts.size(); cut_id++) {
-    const Cut* cut = all_cuts[cut_id].second;
-    for (int leaf : cut->leaves) {
-      node_cut_lists[leaf].push_back(static_cast<int>(cut_id));
+  // Create lists for each node in [lo, hi] to store window indices
+  std::vector<std::vector<int>> node_cut_lists(hi - lo + 1);
+  for (size_t w = 0; w < windows.size(); w++) {
+    for (int leaf : windows[w].inputs) {
+      node_cut_lists[leaf - lo].push_back(static_cast<int>(w));
     }
   }
 
-  // Propagate ALL cut IDs simultaneously in topological order
+  // Propagate ALL window indices simultaneously in topological order
   std::vector<int> common_cuts; // Temporary storage
-  for (int node = aig.nPis + 1; node < aig.nObjs; node++) {
-    int fanin0 = lit2var(aig.vObjs[node * 2]);
-    int fanin1 = lit2var(aig.vObjs[node * 2 + 1]);
-    // Find intersection of cut IDs from both fanins
+  for (int node = std::max(lo, aig.num_pis + 1); node <= hi; node++) {
+    if (!aig.is_gate(node)) continue;
+    int fanin0 = lit2var(aig.fanins[node * 2]);
+    int fanin1 = lit2var(aig.fanins[node * 2 + 1]);
+    if (fanin0 < lo || fanin1 < lo) continue;
+    auto& list0 = node_cut_lists[fanin0 - lo];
+    auto& list1 = node_cut_lists[fanin1 - lo];
+    // Find intersection of window indices from both fanins
     common_cuts.clear();
-    common_cuts.reserve(node_cut_lists[fanin0].size() + node_cut_lists[fanin1].size());
-    std::set_intersection(node_cut_lists[fanin0].begin(), node_cut_lists[fanin0].end(),
-                          node_cut_lists[fanin1].begin(), node_cut_lists[fanin1].end(),
+    common_cuts.reserve(list0.size() + list1.size());
+    std::set_intersection(list0.begin(), list0.end(), list1.begin(), list1.end(),
                           std::back_inserter(common_cuts));
     // Merge the two sorted ranges
     std::vector<int> temp_result;
-    temp_result.reserve(node_cut_lists[node].size() + common_cuts.size());
-    std::set_union(node_cut_lists[node].begin(), node_cut_lists[node].end(),
+    temp_result.reserve(node_cut_lists[node - lo].size() + common_cuts.size());
+    std::set_union(node_cut_lists[node - lo].begin(), node_cut_lists[node - lo].end(),
                    common_cuts.begin(), common_cuts.end(),
                    std::back_inserter(temp_result));
     // Replace the old vector with the newly created, sorted union
-    node_cut_lists[node] = std::move(temp_result);
+    node_cut_lists[node - lo] = std::move(temp_result);
   }
 
-  // Create windows from propagated cut IDs
-  windows.resize(all_cuts.size());
-  for (size_t cut_id = 0; cut_id < all_cuts.size(); cut_id++) {
-    windows[cut_id].target_node = all_cuts[cut_id].first;
-    windows[cut_id].inputs = all_cuts[cut_id].second->leaves;
-    windows[cut_id].cut_id = static_cast<int>(cut_id);
+  for (int i = std::max(lo, 1); i <= hi; i++) {
+    for (int w : node_cut_lists[i - lo]) {
+      windows[w].nodes.push_back(i);
+    }
   }
-  for (int i = 1; i < aig.nObjs; i++) {
-    for (int cut_id : node_cut_lists[i]) {
-      windows[cut_id].nodes.push_back(i);
+}
+
+WindowStream::WindowStream(aigman& aig, const AigSnapshot& snapshot, int max_cut_size, bool verbose)
+  : snapshot(snapshot), native(false), next_target(snapshot.num_pis + 1) {
+  assert(aig.fSorted);
+  if (verbose) std::cout << "Enumerating cuts using exopt...\n";
+  CutEnumeration(aig, exopt_cuts, max_cut_size);
+  if (verbose) std::cout << "Creating windows from cuts...\n";
+}
+
+WindowStream::WindowStream(const AigSnapshot& snapshot, int max_cut_size, int max_cuts_per_node, int num_threads, bool verbose)
+  : snapshot(snapshot), native(true), next_target(snapshot.num_pis + 1) {
+  assert(!snapshot.levels.empty());
+  if (verbose) std::cout << "Enumerating cuts (native, " << num_threads << " threads)...\n";
+  enumerate_cuts(snapshot, max_cut_size, max_cuts_per_node, num_threads, native_cuts);
+  if (verbose) std::cout << "Creating windows from cuts...\n";
+}
+
+bool WindowStream::next(std::vector<Window>& windows, size_t max_windows) {
+  windows.clear();
+  if (next_target >= snapshot.num_objs) return false;
+  // One window per non-trivial cut, numbered in target order
+  for (; next_target < snapshot.num_objs && windows.size() < max_windows; next_target++) {
+    int target = next_target;
+    if (native) {
+      // The first cut of each node is its trivial cut; dead nodes have none
+      if (native_cuts.count[target] == 0) continue;
+      for (const InlineCut* cut = native_cuts.node_begin(target) + 1; cut != native_cuts.node_end(target); ++cut) {
+        windows.emplace_back();
+        Window& window = windows.back();
+        window.target_node = target;
+        window.inputs.assign(cut->begin(), cut->end());
+        window.cut_id = next_cut_id++;
+      }
+    } else {
+      for (auto& cut : exopt_cuts[target]) {
+        if (cut.leaves.size() == 1 && cut.leaves[0] == target) {
+          continue; // Skip trivial cut
+        }
+        windows.emplace_back();
+        Window& window = windows.back();
+        window.target_node = target;
+        window.inputs = std::move(cut.leaves);
+        window.cut_id = next_cut_id++;
+      }
+      std::vector<Cut>().swap(exopt_cuts[target]);
     }
   }
+  collect_window_nodes(snapshot, windows);
+  return true;
+}
+
+void window_enumerate_all(aigman& aig, int max_cut_size, bool verbose, std::vector<Window>& windows) {
+  AigSnapshot snapshot;
+  build_aig_snapshot(aig, 1, snapshot);
+  window_enumerate_all(aig, snapshot, max_cut_size, verbose, windows);
+}
+
+void window_enumerate_all(aigman& aig, const AigSnapshot& snapshot, int max_cut_size, bool verbose, std::vector<Window>& windows) {
+  WindowStream stream(aig, snapshot, max_cut_size, verbose);
+  stream.next(windows, SIZE_MAX);
+}
+
+void window_enumerate_all_native(aigman& aig, int max_cut_size, int max_cuts_per_node, int num_threads, bool verbose, std::vector<Window>& windows) {
+  AigSnapshot snapshot;
+  build_aig_snapshot(aig, num_threads, snapshot);
+  window_enumerate_all_native(snapshot, max_cut_size, max_cuts_per_node, num_threads, verbose, windows);
+}
+
+void window_enumerate_all_native(const AigSnapshot& aig, int max_cut_size, int max_cuts_per_node, int num_threads, bool verbose, std::vector<Window>& windows) {
+  WindowStream stream(aig, max_cut_size, max_cuts_per_node, num_threads, verbose);
+  stream.next(windows, SIZE_MAX);
+}
+
+void window_analyze_all(aigman& aig, std::vector<Window>& windows) {
+  AigSnapshot snapshot;
+  build_aig_snapshot(aig, 1, snapshot);
+  window_analyze_all(snapshot, windows, 1);
+}
+
+void window_analyze_all(const AigSnapshot& aig, std::vector<Window>& windows, int num_threads) {
 
-  // Compute divisors = window nodes - MFFC(target) - TFO(target)
-  std::vector<int> deref; // reuse across windows
-  deref.assign(aig.nObjs, 0);
-  for (auto& window : windows) {
-    std::unordered_set<int> mffc = compute_mffc(aig, window.target_node, deref);
-    std::unordered_set<int> tfo = compute_tfo_in_window(aig, window.target_node, window.nodes);
-    for (int node : window.nodes) {
-      if (mffc.find(node) == mffc.end() && tfo.find(node) == tfo.end()) {
-        window.divisors.push_back(node);
+  // Compute divisors = window nodes - MFFC(target) - TFO(target) on the
+  // window-local snapshot, so each window is pulled into cache once
+  parallel_for_chunks(0, static_cast<int>(windows.size()), num_threads, 256, [&](int b, int e, int) {
+    std::vector<int> deref(aig.num_objs, 0); // reuse across windows of the chunk
+    for (int w = b; w < e; w++) {
+      Window& window = windows[w];
+      build_window_snapshot(aig, window);
+      window.mffc_size = mark_mffc_in_window(aig, window, deref);
+      mark_tfo_in_window(window);
+      auto& local = window.local;
+      for (int i = 0; i < static_cast<int>(window.nodes.size()); i++) {
+        if (!(local.flags[i] & (WindowSnapshot::MFFC | WindowSnapshot::TFO))) {
+          local.flags[i] |= WindowSnapshot::DIVISOR;
+          local.divisors.push_back(i);
+          window.divisors.push_back(window.nodes[i]);
+        }
       }
     }
-    window.mffc_size = static_cast<int>(mffc.size());
+  });
+}
+
+// Interleave the bits of two 32-bit keys (Morton / Z-order)
+static uint64_t interleave_bits(uint32_t x, uint32_t y) {
+  uint64_t key = 0;
+  for (int b = 0; b < 32; b++) {
+    key |= static_cast<uint64_t>((x >> b) & 1) << (2 * b + 1);
+    key |= static_cast<uint64_t>((y >> b) & 1) << (2 * b);
+  }
+  return key;
+}
+
+void window_order(aigman const& aig, std::vector<Window>& windows, WindowOrder order) {
+  if (order == WindowOrder::CUT_ID) {
+    std::sort(windows.begin(), windows.end(), [](const Window& a, const Window& b) {
+      return a.cut_id < b.cut_id;
+    });
+    return;
+  }
+  std::vector<std::pair<uint64_t, int>> keys; // (key, index)
+  keys.reserve(windows.size());
+  if (order == WindowOrder::LEVEL) {
+    std::vector<int> levels = compute_levels(aig);
+    for (size_t i = 0; i < windows.size(); i++) {
+      int target = windows[i].target_node;
+      uint64_t key = (static_cast<uint64_t>(levels[target]) << 32) | static_cast<uint32_t>(target);
+      keys.emplace_back(key, static_cast<int>(i));
+    }
+  } else {
+    for (size_t i = 0; i < windows.size(); i++) {
+      const auto& w = windows[i];
+      int min_leaf = *std::min_element(w.inputs.begin(), w.inputs.end());
+      keys.emplace_back(interleave_bits(w.target_node, min_leaf), static_cast<int>(i));
+    }
+  }
+  // Ties keep cut-ID order through the index
+  std::sort(keys.begin(), keys.end());
+  std::vector<Window> sorted;
+  sorted.reserve(windows.size());
+  for (auto& [key, idx] : keys) {
+    sorted.push_back(std::move(windows[idx]));
   }
+  windows = std::move(sorted);
 }
 
 std::unordered_set<int> compute_tfo_in_window(aigman& aig, int root, const std::vector<int>& window_nodes) {
@@ -112,4 +233,133 @@ std::unordered_set<int> compute_tfo_in_window(aigman& aig, int root, const std::
   return tfo;
 }
 
+// Local id of a global node; window.nodes is sorted, so binary search suffices
+static int local_id(const Window& window, int node) {
+  auto it = std::lower_bound(window.nodes.begin(), window.nodes.end(), node);
+  assert(it != window.nodes.end() && *it == node);
+  return static_cast<int>(it - window.nodes.begin());
+}
+
+// Shared by the aigman and AigSnapshot versions; fanin(node, k) is a global literal
+template <typename Fanin>
+static void build_window_snapshot_impl(const Fanin& fanin, Window& window) {
+  auto& local = window.local;
+  int n = static_cast<int>(window.nodes.size());
+  local.fanins.assign(2 * n, -1);
+  local.flags.assign(n, 0);
+  local.inputs.clear();
+  local.divisors.clear();
+  local.mffc_below.clear();
+  for (int input : window.inputs) {
+    int id = local_id(window, input);
+    local.flags[id] |= WindowSnapshot::INPUT;
+    local.inputs.push_back(id);
+  }
+  for (int divisor : window.divisors) {
+    int id = local_id(window, divisor);
+    local.flags[id] |= WindowSnapshot::DIVISOR;
+    local.divisors.push_back(id);
+  }
+  local.target = local_id(window, window.target_node);
+
+  // Fanin literals in local ids; fanout CSR built by counting then filling
+  local.fanout_offsets.assign(n + 1, 0);
+  for (int i = 0; i < n; i++) {
+    if (local.flags[i] & WindowSnapshot::INPUT) continue;
+    int node = window.nodes[i];
+    for (int k = 0; k < 2; k++) {
+      int lit = fanin(node, k);
+      int fi = local_id(window, lit2var(lit));
+      assert(fi < i);
+      local.fanins[2 * i + k] = var2lit(fi, is_complemented(lit));
+      local.fanout_offsets[fi + 1]++;
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    local.fanout_offsets[i + 1] += local.fanout_offsets[i];
+  }
+  local.fanout_indices.resize(local.fanout_offsets[n]);
+  std::vector<int> fill(local.fanout_offsets.begin(), local.fanout_offsets.end() - 1);
+  for (int i = 0; i < n; i++) {
+    if (local.flags[i] & WindowSnapshot::INPUT) continue;
+    local.fanout_indices[fill[lit2var(local.fanins[2 * i])]++] = i;
+    local.fanout_indices[fill[lit2var(local.fanins[2 * i + 1])]++] = i;
+  }
+}
+
+void build_window_snapshot(aigman const& aig, Window& window) {
+  build_window_snapshot_impl([&aig](int node, int k) { return aig.vObjs[node * 2 + k]; }, window);
+}
+
+void build_window_snapshot(const AigSnapshot& aig, Window& window) {
+  build_window_snapshot_impl([&aig](int node, int k) { return aig.fanins[node * 2 + k]; }, window);
+}
+
+int mark_mffc_in_window(const AigSnapshot& aig, Window& window, std::vector<int>& deref) {
+  if (static_cast<int>(deref.size()) < aig.num_objs) deref.resize(aig.num_objs);
+  auto& local = window.local;
+  int n = static_cast<int>(window.nodes.size());
+  local.refs.resize(n);
+  for (int i = 0; i < n; i++) {
+    local.refs[i] = aig.refs[window.nodes[i]];
+  }
+  assert(window.target_node > aig.num_pis);
+
+  // Same dereference scheme as compute_mffc. Window nodes are counted in a
+  // local array and expanded through local fanins; leaves fall back to the
+  // global fanins, and nodes outside the window use the global `deref`.
+  std::vector<int> local_deref(n, 0);
+  std::vector<int> touched;
+  std::vector<std::pair<int, int>> stack; // (global id, local id or -1)
+  local_deref[local.target] = local.refs[local.target];
+  local.flags[local.target] |= WindowSnapshot::MFFC;
+  stack.emplace_back(window.target_node, local.target);
+  int size = 1;
+  while (!stack.empty()) {
+    auto [node, id] = stack.back();
+    stack.pop_back();
+    bool has_local_fanins = id >= 0 && !(local.flags[id] & WindowSnapshot::INPUT);
+    for (int k = 0; k < 2; k++) {
+      int fi = lit2var(aig.fanins[node * 2 + k]);
+      if (fi <= aig.num_pis) continue; // stop at PIs
+      int fid = -1;
+      if (has_local_fanins) {
+        fid = lit2var(local.fanins[2 * id + k]);
+      } else {
+        auto it = std::lower_bound(window.nodes.begin(), window.nodes.end(), fi);
+        if (it != window.nodes.end() && *it == fi) fid = static_cast<int>(it - window.nodes.begin());
+      }
+      if (fid >= 0) {
+        if (++local_deref[fid] != local.refs[fid]) continue;
+        local.flags[fid] |= WindowSnapshot::MFFC;
+      } else {
+        if (deref[fi] == 0) touched.push_back(fi);
+        if (++deref[fi] != aig.refs[fi]) continue;
+        local.mffc_below.push_back(fi);
+      }
+      size++;
+      stack.emplace_back(fi, fid);
+    }
+  }
+  for (int t : touched) deref[t] = 0;
+  std::sort(local.mffc_below.begin(), local.mffc_below.end());
+  return size;
+}
+
+void mark_tfo_in_window(Window& window) {
+  auto& local = window.local;
+  std::vector<int> stack = {local.target};
+  local.flags[local.target] |= WindowSnapshot::TFO;
+  while (!stack.empty()) {
+    int i = stack.back();
+    stack.pop_back();
+    for (int o = local.fanout_offsets[i]; o < local.fanout_offsets[i + 1]; o++) {
+      int fo = local.fanout_indices[o];
+      if (local.flags[fo] & WindowSnapshot::TFO) continue;
+      local.flags[fo] |= WindowSnapshot::TFO;
+      stack.push_back(fo);
+    }
+  }
+}
+
 } // namespace fresub
@@ -0,0 +1,249 @@
+#include "window_cache.hpp"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fresub {
+
+  // File layout:
+  //   header: "FRSCACH1"
+  //   record: u64 payload_size, u64 hash, payload
+  //   payload: u32 mode, u32 key_len, i32 key[key_len],
+  //            u32 n_tts, u32 num_words, u64 tts[n_tts * num_words],
+  //            u32 n_sets, n_sets x (u16 count, u16 idx[4])
+  static const char kMagic[8] = {'F', 'R', 'S', 'C', 'A', 'C', 'H', '1'};
+
+  // Structural key of a window: its local cone, the positions of the divisors
+  // and target, and the global fanout counts (which decide the ODC observation
+  // points). Truth tables and care masks depend on nothing else; feasible sets
+  // with virtual divisors (mode 3) also depend on the MFFC size.
+  static std::vector<int32_t> structural_key(const Window& window, uint32_t mode) {
+    const WindowSnapshot& local = window.local;
+    std::vector<int32_t> key;
+    key.reserve(5 + local.fanins.size() + local.divisors.size() + local.refs.size());
+    key.push_back(static_cast<int32_t>(local.inputs.size()));
+    key.push_back(static_cast<int32_t>(local.flags.size()));
+    key.push_back(local.target);
+    key.push_back(static_cast<int32_t>(local.divisors.size()));
+    key.insert(key.end(), local.fanins.begin(), local.fanins.end());
+    key.insert(key.end(), local.divisors.begin(), local.divisors.end());
+    key.insert(key.end(), local.refs.begin(), local.refs.end());
+    // Virtual divisors are only tried for MFFCs of more than 3 gates
+    if ((mode & 0xff) == 3) key.push_back(window.mffc_size);
+    return key;
+  }
+
+  static uint64_t structural_hash(const std::vector<int32_t>& key, uint32_t mode) {
+    uint64_t h = 0xcbf29ce484222325ull ^ mode;
+    for (int32_t v : key) {
+      h ^= static_cast<uint32_t>(v);
+      h *= 0x100000001b3ull;
+      h ^= h >> 29;
+    }
+    return h;
+  }
+
+  template <typename T>
+  static T read_at(const unsigned char* p, size_t& off) {
+    T v;
+    std::memcpy(&v, p + off, sizeof(T));
+    off += sizeof(T);
+    return v;
+  }
+
+  template <typename T>
+  static bool get(const unsigned char*& p, const unsigned char* end, T& v) {
+    if (static_cast<size_t>(end - p) < sizeof(T)) return false;
+    std::memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+  }
+
+  template <typename T>
+  static void put(std::vector<unsigned char>& buf, T v) {
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &v, sizeof(T));
+    buf.insert(buf.end(), bytes, bytes + sizeof(T));
+  }
+
+  static bool write_all(int fd, const unsigned char* p, size_t n, size_t off) {
+    while (n > 0) {
+      ssize_t w = pwrite(fd, p, n, off);
+      if (w <= 0) return false;
+      p += w;
+      n -= w;
+      off += w;
+    }
+    return true;
+  }
+
+  WindowCache::~WindowCache() {
+    if (data) munmap(const_cast<unsigned char*>(data), mapped_size);
+    if (fd >= 0) close(fd);
+  }
+
+  bool WindowCache::open(const std::string& path) {
+    assert(fd < 0);
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+      std::cerr << "Error: cannot open cache file " << path << ": " << std::strerror(errno) << "\n";
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      std::cerr << "Error: cannot stat cache file " << path << "\n";
+      return false;
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+      if (!write_all(fd, reinterpret_cast<const unsigned char*>(kMagic), sizeof(kMagic), 0)) {
+        std::cerr << "Error: cannot write cache file " << path << "\n";
+        return false;
+      }
+      file_size = sizeof(kMagic);
+      return true;
+    }
+    if (size < sizeof(kMagic)) {
+      std::cerr << "Error: " << path << " is not a fresub cache file\n";
+      return false;
+    }
+    void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      std::cerr << "Error: cannot map cache file " << path << "\n";
+      return false;
+    }
+    data = static_cast<const unsigned char*>(p);
+    mapped_size = size;
+    if (std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+      std::cerr << "Error: " << path << " is not a fresub cache file\n";
+      return false;
+    }
+    // Index complete records; drop a truncated tail
+    size_t off = sizeof(kMagic);
+    while (off + 16 <= size) {
+      size_t at = off;
+      uint64_t payload = read_at<uint64_t>(data, at);
+      uint64_t hash = read_at<uint64_t>(data, at);
+      if (payload > size - at) break;
+      index[hash].push_back(off);
+      off = at + payload;
+    }
+    if (off < size && ftruncate(fd, off) != 0) {
+      std::cerr << "Error: cannot truncate cache file " << path << "\n";
+      return false;
+    }
+    file_size = off;
+    return true;
+  }
+
+  bool WindowCache::decode_record(size_t record, const std::vector<int32_t>& key, uint32_t mode, Window& window) {
+    size_t at = record;
+    uint64_t payload = read_at<uint64_t>(data, at);  // bounded by open()
+    const unsigned char* p = data + record + 16;
+    const unsigned char* end = p + payload;
+    uint32_t record_mode, key_len;
+    if (!get(p, end, record_mode) || record_mode != mode || !get(p, end, key_len) || key_len != key.size() ||
+        static_cast<size_t>(end - p) / sizeof(int32_t) < key_len ||
+        std::memcmp(p, key.data(), key_len * sizeof(int32_t)) != 0) {
+      return false;
+    }
+    p += key_len * sizeof(int32_t);
+    uint32_t n_tts, num_words;
+    if (!get(p, end, n_tts) || !get(p, end, num_words) || n_tts != window.divisors.size() + 1 || num_words == 0 ||
+        static_cast<size_t>(end - p) / sizeof(uint64_t) / num_words < n_tts) {
+      return false;
+    }
+    std::vector<uint64_t> tt(num_words);  // records are not 8-byte aligned
+    window.truth_tables.clear();
+    for (uint32_t t = 0; t < n_tts; t++) {
+      std::memcpy(tt.data(), p, num_words * sizeof(uint64_t));
+      p += num_words * sizeof(uint64_t);
+      window.truth_tables.push_back(tt.data(), num_words);
+    }
+    uint32_t n_sets;
+    bool ok = get(p, end, n_sets) && static_cast<size_t>(end - p) / (5 * sizeof(uint16_t)) >= n_sets;
+    window.feasible_sets.clear();
+    if (ok) window.feasible_sets.reserve(n_sets);
+    for (uint32_t s = 0; ok && s < n_sets; s++) {
+      FeasibleSet fs;
+      fs.window_id = window.cut_id;
+      size_t off = 0;  // the 5 fields are within bounds, checked above
+      uint16_t count = read_at<uint16_t>(p, off);
+      ok = count <= 4;
+      for (int i = 0; ok && i < count; i++) {
+        uint16_t idx = read_at<uint16_t>(p, off);
+        ok = idx < window.divisors.size();
+        fs.divisor_indices.push_back(idx);
+      }
+      p += 5 * sizeof(uint16_t);
+      window.feasible_sets.push_back(fs);
+    }
+    if (!ok) {
+      window.truth_tables.clear();
+      window.feasible_sets.clear();
+    }
+    return ok;
+  }
+
+  bool WindowCache::lookup(Window& window, uint32_t mode) {
+    assert(fd >= 0);
+    std::vector<int32_t> key = structural_key(window, mode);
+    uint64_t hash = structural_hash(key, mode);
+    auto bucket = index.find(hash);
+    if (bucket != index.end()) {
+      for (size_t record : bucket->second) {
+        if (decode_record(record, key, mode, window)) {
+          hits++;
+          return true;
+        }
+      }
+    }
+    misses++;
+    return false;
+  }
+
+  void WindowCache::append(const Window& window, uint32_t mode) {
+    assert(fd >= 0);
+    assert(window.feasible_bitmap.empty());
+    std::vector<int32_t> key = structural_key(window, mode);
+    uint64_t hash = structural_hash(key, mode);
+    if (index.count(hash) || !written.insert(hash).second) return;
+
+    std::vector<unsigned char> buf;
+    put<uint64_t>(buf, 0);  // payload size, patched below
+    put<uint64_t>(buf, hash);
+    put<uint32_t>(buf, mode);
+    put<uint32_t>(buf, key.size());
+    for (int32_t v : key) put<int32_t>(buf, v);
+    uint32_t num_words = window.truth_tables.empty() ? 0 : window.truth_tables[0].size();
+    put<uint32_t>(buf, window.truth_tables.size());
+    put<uint32_t>(buf, num_words);
+    for (const auto& tt : window.truth_tables) {
+      assert(tt.size() == num_words);
+      for (uint64_t word : tt) put<uint64_t>(buf, word);
+    }
+    put<uint32_t>(buf, window.feasible_sets.size());
+    for (const auto& fs : window.feasible_sets) {
+      put<uint16_t>(buf, fs.divisor_indices.size());
+      for (size_t i = 0; i < 4; i++) {
+        put<uint16_t>(buf, i < fs.divisor_indices.size() ? fs.divisor_indices[i] : 0);
+      }
+    }
+    uint64_t payload = buf.size() - 16;
+    std::memcpy(buf.data(), &payload, sizeof(payload));
+    if (!write_all(fd, buf.data(), buf.size(), file_size)) {
+      std::cerr << "Warning: failed to append to cache file\n";
+      return;
+    }
+    file_size += buf.size();
+    appended++;
+  }
+
+} // namespace fresub
@@ -4,25 +4,7 @@
 #include <vector>
 #include <cstdint>
 
-// Need to include Window definition - must match the real struct layout
-// This is a bit hacky but avoids pulling in the full AIG dependencies
-namespace fresub {
-struct aigman; // forward declaration for pointer use
-struct FeasibleSet {
-    std::vector<int> divisor_indices;
-    std::vector<aigman*> synths;
-};
-struct Window {
-    int target_node;
-    std::vector<int> inputs;     // Window inputs (cut leaves)
-    std::vector<int> nodes;      // All nodes in window
-    std::vector<int> divisors;   // Window nodes - MFFC(target)
-    int cut_id;                  // ID of the cut that generated this window
-    int mffc_size;
-    std::vector<std::vector<uint64_t>> truth_tables;
-    std::vector<FeasibleSet> feasible_sets;
-};
-}
+#include "cuda_problems.hpp"
 
 #define word_width 64
 #define THREADS_PER_PROBLEM 32
@@ -193,88 +175,5 @@ void solve_resub_problems_cuda(uint64_t *flat_problems, uint32_t *solutions,
     CHECK_CUDA_ERROR(cudaFree(d_num_inputs));
 }
 
-// Convert solution mask to vector of divisor indices
-std::vector<int> mask_to_indices(uint32_t mask) {
-    std::vector<int> indices;
-    for (int i = 0; i < 32; i++) {
-        if (mask & (1U << i)) {
-            indices.push_back(i);
-        }
-    }
-    return indices;
-}
-
 } // namespace cuda
 } // namespace fresub
-
-namespace fresub {
-
-// CUDA-compatible feasibility check function with vector iterator interface (original version)
-void feasibility_check_cuda(std::vector<Window>::iterator begin, std::vector<Window>::iterator end) {
-    int M = std::distance(begin, end);  // Number of problems (windows)
-    if (M == 0) return;
-    
-    // Calculate total size needed and build offset array
-    std::vector<int> problem_offsets(M + 1);  // M+1 elements
-    std::vector<int> num_inputs(M);
-    int total_elements = 0;
-    
-    int idx = 0;
-    for (auto it = begin; it != end; ++it, ++idx) {
-        int N = it->inputs.size();
-        num_inputs[idx] = N;
-        int size = 1 << N;
-        int nWords = (size + 63) / 64;  // More standard rounding up
-        int n_truth_tables = it->truth_tables.size();  // divisors + target
-        
-        problem_offsets[idx] = total_elements;
-        total_elements += n_truth_tables * nWords;
-    }
-    problem_offsets[M] = total_elements;  // Last element points to end
-    
-    // Allocate flattened array with exact size needed
-    std::vector<uint64_t> flat_problems(total_elements, 0);
-    
-    // Flatten all windows into the array
-    idx = 0;
-    for (auto it = begin; it != end; ++it, ++idx) {
-        int N = it->inputs.size();
-        int size = 1 << N;
-        int nWords = size / 64 + (size % 64 != 0 ? 1 : 0);
-        int problem_offset = problem_offsets[idx];
-        
-        // Copy all truth tables (divisors + target)
-        for (size_t t = 0; t < it->truth_tables.size(); t++) {
-            for (int w = 0; w < nWords; w++) {
-                if (w < (int)it->truth_tables[t].size()) {
-                    flat_problems[problem_offset + t * nWords + w] = it->truth_tables[t][w];
-                }
-            }
-        }
-    }
-    
-    // Allocate solutions array
-    std::vector<uint32_t> solutions(M);
-    
-    // Call CUDA kernel with original interface (finds first feasible solution only)
-    cuda::solve_resub_problems_cuda(flat_problems.data(), solutions.data(), 
-                                    problem_offsets.data(), num_inputs.data(), 
-                                    M, total_elements);
-    
-    // Convert results back to feasible sets for each window
-    idx = 0;
-    for (auto it = begin; it != end; ++it, ++idx) {
-        uint32_t mask = solutions[idx];
-        
-        if (mask != 0) {
-            // Convert mask to indices and store in window - assume indices are valid
-            std::vector<int> indices = cuda::mask_to_indices(mask);
-            // Populate feasible_sets with divisor indices only
-            FeasibleSet fs;
-            fs.divisor_indices = std::move(indices);
-            it->feasible_sets.push_back(std::move(fs));
-        }
-    }
-}
-
-} // namespace fresub
@@ -5,24 +5,7 @@
 #include <cstdint>
 #include <cassert>
 
-// Need to include Window definition - must match the real struct layout
-namespace fresub {
-struct aigman; // forward declaration for pointer use
-struct FeasibleSet {
-    std::vector<int> divisor_indices;
-    std::vector<aigman*> synths;
-};
-struct Window {
-    int target_node;
-    std::vector<int> inputs;     // Window inputs (cut leaves)
-    std::vector<int> nodes;      // All nodes in window
-    std::vector<int> divisors;   // Window nodes - MFFC(target)
-    int cut_id;                  // ID of the cut that generated this window
-    int mffc_size;
-    std::vector<std::vector<uint64_t>> truth_tables;
-    std::vector<FeasibleSet> feasible_sets;
-};
-}
+#include "cuda_problems.hpp"
 
 #define word_width 64
 #define THREADS_PER_PROBLEM 32
@@ -130,92 +113,3 @@ void solve_resub_problems_cuda_all(uint64_t *flat_problems, char *feasibility_re
 
 } // namespace cuda
 } // namespace fresub
-
-namespace fresub {
-
-// CUDA-compatible feasibility check function that finds ALL feasible sets
-void feasibility_check_cuda_all(std::vector<Window>::iterator begin, std::vector<Window>::iterator end) {
-    int M = std::distance(begin, end);  // Number of problems (windows)
-    if (M == 0) return;
-    
-    // Calculate total size needed for truth tables and build offset arrays
-    std::vector<int> problem_offsets(M + 1);  // M+1 elements
-    std::vector<int> combination_offsets(M + 1);  // M+1 elements
-    std::vector<int> num_inputs(M);
-    int total_elements = 0;
-    int total_combinations = 0;
-    
-    int idx = 0;
-    for (auto it = begin; it != end; ++it, ++idx) {
-        int N = it->inputs.size();
-        num_inputs[idx] = N;
-        int size = 1 << N;
-        int nWords = (size + 63) / 64;  // More standard rounding up
-        int n_truth_tables = it->truth_tables.size();  // divisors + target
-        int n_divs = n_truth_tables - 1;  // -1 for target
-        
-        problem_offsets[idx] = total_elements;
-        total_elements += n_truth_tables * nWords;
-        
-        combination_offsets[idx] = total_combinations;
-        total_combinations += n_divs * n_divs * n_divs * n_divs;  // D^4 combinations
-    }
-    problem_offsets[M] = total_elements;  // Last element points to end
-    combination_offsets[M] = total_combinations;  // Last element points to end
-    
-    // Allocate flattened arrays
-    std::vector<uint64_t> flat_problems(total_elements, 0);
-    std::vector<char> feasibility_results(total_combinations, 0);  // Use char instead of bool
-    
-    // Flatten all windows into the truth table array
-    idx = 0;
-    for (auto it = begin; it != end; ++it, ++idx) {
-        int N = it->inputs.size();
-        int size = 1 << N;
-        int nWords = size / 64 + (size % 64 != 0 ? 1 : 0);
-        int problem_offset = problem_offsets[idx];
-        
-        // Copy all truth tables (divisors + target)
-        for (size_t t = 0; t < it->truth_tables.size(); t++) {
-            for (int w = 0; w < nWords; w++) {
-                if (w < (int)it->truth_tables[t].size()) {
-                    flat_problems[problem_offset + t * nWords + w] = it->truth_tables[t][w];
-                }
-            }
-        }
-    }
-    
-    // Call CUDA kernel to find all feasible sets
-    cuda::solve_resub_problems_cuda_all(flat_problems.data(), feasibility_results.data(),
-                                        problem_offsets.data(), combination_offsets.data(),
-                                        num_inputs.data(), M, total_elements, total_combinations);
-    
-    // Convert results back to feasible sets for each window
-    idx = 0;
-    for (auto it = begin; it != end; ++it, ++idx) {
-        int n_divs = it->truth_tables.size() - 1;  // -1 for target
-        int combination_base = combination_offsets[idx];
-        
-        assert(it->feasible_sets.empty());
-        
-        // Check all valid combinations (i < j < k < l)
-        for (int i = 0; i < n_divs; i++) {
-            for (int j = i + 1; j < n_divs; j++) {
-                for (int k = j + 1; k < n_divs; k++) {
-                    for (int l = k + 1; l < n_divs; l++) {
-                        int combination_idx = l + k * n_divs + j * n_divs * n_divs + i * n_divs * n_divs * n_divs;
-                        int global_idx = combination_base + combination_idx;
-                        
-                        if (feasibility_results[global_idx]) {
-                            FeasibleSet fs;
-                            fs.divisor_indices = {i, j, k, l};
-                            it->feasible_sets.push_back(std::move(fs));
-                        }
-                    }
-                }
-            }
-        }
-    }
-}
-
-} // namespace fresub
@@ -1,4 +1,7 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 
 #include <aig.hpp>
@@ -6,6 +9,7 @@
 #include "feasibility.hpp"
 #include "simulation.hpp"
 #include "window.hpp"
+#include "window_cache.hpp"
 
 int total_tests = 0;
 int passed_tests = 0;
@@ -345,6 +349,387 @@ void test_find_feasible_4resub() {
     std::cout << "✓ find_feasible_4resub working\n";
 }
 
+void test_combination_rank_and_bitmap() {
+    std::cout << "\n=== TESTING COMBINATION RANKS AND BITMAP RESULTS ===\n";
+    
+    // Packed feasible sets stay small and allocation-free
+    ASSERT(sizeof(FeasibleSet) <= 24);
+    
+    // Rank/unrank round trip over all 4-combinations of 9 elements
+    int n = 9;
+    uint64_t expected_rank = 0;
+    bool roundtrip_ok = true;
+    for (int i = 0; i < n; i++)
+        for (int j = i + 1; j < n; j++)
+            for (int k = j + 1; k < n; k++)
+                for (int l = k + 1; l < n; l++) {
+                    DivisorIndices c = {i, j, k, l};
+                    uint64_t r = combination_rank(c);
+                    DivisorIndices u = combination_unrank(r, 4);
+                    if (r >= combination_count(n, 4)) roundtrip_ok = false;
+                    for (int x = 0; x < 4; x++) if (u[x] != c[x]) roundtrip_ok = false;
+                    expected_rank++;
+                }
+    ASSERT(roundtrip_ok);
+    ASSERT(expected_rank == combination_count(n, 4));
+    ASSERT(combination_count(4, 4) == 1 && combination_count(3, 4) == 0);
+    
+    // Bitmap ALL mode must report exactly the sets of vector ALL mode
+    const uint64_t A = 0xaaaaaaaaaaaaaaaaull;
+    const uint64_t B = 0xccccccccccccccccull;
+    const uint64_t C = 0xf0f0f0f0f0f0f0f0ull;
+    const uint64_t D = 0xff00ff00ff00ff00ull;
+    std::vector<Window> windows(2);
+    windows[0].inputs = {1, 2, 3, 4};
+    windows[0].cut_id = 0;
+    windows[0].truth_tables = { {A}, {B}, {C}, {D}, {A & B}, {C & D}, {(A & B) | (C & D)} };
+    windows[1].inputs = {1, 2, 3, 4};
+    windows[1].cut_id = 1;
+    windows[1].truth_tables = { {A}, {B}, {A ^ B} };
+    std::vector<Window> bitmap_windows = windows;
+    feasibility_check_cpu_all(windows.begin(), windows.end());
+    feasibility_check_cpu_all_bitmap(bitmap_windows.begin(), bitmap_windows.end());
+    for (size_t w = 0; w < windows.size(); w++) {
+        ASSERT(bitmap_windows[w].feasible_sets.empty());
+        expand_feasible_bitmap(bitmap_windows[w]);
+        // Bitmap results come out in rank (colex) order; compare as sets of ranks
+        std::vector<uint64_t> a, b;
+        for (const auto& fs : windows[w].feasible_sets) a.push_back(combination_rank(fs.divisor_indices));
+        for (const auto& fs : bitmap_windows[w].feasible_sets) {
+            b.push_back(combination_rank(fs.divisor_indices));
+            ASSERT(fs.window_id == windows[w].cut_id);
+        }
+        std::sort(a.begin(), a.end());
+        ASSERT(!a.empty());
+        ASSERT(a == b);
+    }
+    std::cout << "✓ Combination ranks and bitmap results consistent\n";
+}
+
+void test_feasible_visitor() {
+    std::cout << "\n=== TESTING FEASIBLE-SET VISITOR ===\n";
+    
+    const int num_inputs = 4;
+    const uint64_t A = 0xaaaaaaaaaaaaaaaaull;
+    const uint64_t B = 0xccccccccccccccccull;
+    const uint64_t C = 0xf0f0f0f0f0f0f0f0ull;
+    const uint64_t D = 0xff00ff00ff00ff00ull;
+    // Target A&B: feasible sets contain {0, 1} or divisor 4 (a copy of the target)
+    std::vector<std::vector<uint64_t>> tts = { {A}, {B}, {C}, {D}, {A & B}, {A & B} };
+    
+    std::vector<FeasibleSet> all;
+    find_feasible_3resub(tts, num_inputs, all);
+    ASSERT(!all.empty());
+    
+    // Visiting everything sees exactly the vector-returning results, in order
+    std::vector<DivisorIndices> visited;
+    int counted = enumerate_feasible(tts, num_inputs, 3, [&](const DivisorIndices& c) {
+        visited.push_back(c);
+        return FeasibleVisit::ACCEPT;
+    });
+    ASSERT(counted == static_cast<int>(all.size()));
+    ASSERT(visited.size() == all.size());
+    bool same_order = visited.size() == all.size();
+    for (size_t i = 0; same_order && i < visited.size(); i++) {
+        same_order = std::equal(visited[i].begin(), visited[i].end(),
+                                all[i].divisor_indices.begin(), all[i].divisor_indices.end());
+    }
+    ASSERT(same_order);
+    
+    // STOP ends the enumeration after the first result
+    int calls = 0;
+    counted = enumerate_feasible(tts, num_inputs, 3, [&](const DivisorIndices&) {
+        calls++;
+        return FeasibleVisit::STOP;
+    });
+    ASSERT(calls == 1 && counted == 1);
+    
+    // REJECT filters without stopping: keep only sets that avoid divisor 4
+    counted = enumerate_feasible(tts, num_inputs, 3, [&](const DivisorIndices& c) {
+        return std::find(c.begin(), c.end(), 4) == c.end() ? FeasibleVisit::ACCEPT : FeasibleVisit::REJECT;
+    });
+    ASSERT(counted > 0 && counted < static_cast<int>(all.size()));
+    
+    // First-N helper
+    std::vector<FeasibleSet> first2;
+    ASSERT(find_feasible_first_n(tts, num_inputs, 3, 2, first2) == 2);
+    ASSERT(first2.size() == 2);
+    ASSERT(std::equal(first2[1].divisor_indices.begin(), first2[1].divisor_indices.end(),
+                      all[1].divisor_indices.begin(), all[1].divisor_indices.end()));
+    
+    // k larger than the number of divisors visits nothing
+    std::vector<std::vector<uint64_t>> small = { {A}, {A} };
+    ASSERT(enumerate_feasible(small, num_inputs, 2, [](const DivisorIndices&) { return FeasibleVisit::ACCEPT; }) == 0);
+    std::cout << "✓ Feasible-set visitor working\n";
+}
+
+void test_find_feasible_best_n() {
+    std::cout << "\n=== TESTING BEST-N FEASIBLE SETS ===\n";
+    
+    int num_inputs = 4;
+    std::vector<std::vector<uint64_t>> tts = {
+        {0xaaaa}, {0xcccc}, {0xf0f0}, {0xff00}, {0xaaaa & 0xcccc}, {0xf0f0 & 0xff00},
+        {(0xaaaa & 0xcccc) | (0xf0f0 & 0xff00)} };
+    std::vector<FeasibleSet> all;
+    find_feasible_4resub(tts, num_inputs, all);
+    ASSERT(all.size() > 2);
+    
+    // Cost: sum of indices, so low-index combinations rank first
+    auto cost = [](const DivisorIndices& c) {
+        int sum = 0;
+        for (int i : c) sum += i;
+        return sum;
+    };
+    std::vector<FeasibleSet> best;
+    int kept = find_feasible_best_n(tts, num_inputs, 4, 2, cost, best);
+    ASSERT(kept == 2 && best.size() == 2);
+    int min_cost = 1 << 30;
+    for (const auto& fs : all) min_cost = std::min(min_cost, cost(fs.divisor_indices));
+    ASSERT(cost(best[0].divisor_indices) == min_cost);
+    ASSERT(cost(best[0].divisor_indices) <= cost(best[1].divisor_indices));
+    int better_than_second = 0;
+    for (const auto& fs : all) if (cost(fs.divisor_indices) < cost(best[1].divisor_indices)) better_than_second++;
+    ASSERT(better_than_second <= 1);
+    
+    // n larger than the number of results keeps everything
+    std::vector<FeasibleSet> everything;
+    ASSERT(find_feasible_best_n(tts, num_inputs, 4, 1000, cost, everything) == static_cast<int>(all.size()));
+    std::cout << "✓ Best-N feasible sets working\n";
+}
+
+void test_feasibility_first_mode() {
+    std::cout << "\n=== TESTING FIRST MODE WITH DIVISOR ORDERING ===\n";
+    
+    const uint64_t A = 0xaaaaaaaaaaaaaaaaull;
+    const uint64_t B = 0xccccccccccccccccull;
+    const uint64_t C = 0xf0f0f0f0f0f0f0f0ull;
+    const uint64_t D = 0xff00ff00ff00ff00ull;
+    // Target = C & D; C and D separate the most onset/offset pairs
+    std::vector<std::vector<uint64_t>> tts = { {A & B}, {A}, {B}, {C}, {D}, {C & D} };
+    std::vector<int> order = order_divisors_by_distinguishing_power(tts, 4);
+    ASSERT(order.size() == 5);
+    ASSERT((order[0] == 3 && order[1] == 4) || (order[0] == 4 && order[1] == 3));
+    
+    std::vector<Window> windows(2);
+    windows[0].inputs = {1, 2, 3, 4};
+    windows[0].cut_id = 7;
+    windows[0].truth_tables = tts;
+    windows[1].inputs = {1, 2, 3, 4};
+    windows[1].cut_id = 8;
+    windows[1].truth_tables = { {A}, {B}, {C} };  // C is not a function of A, B
+    feasibility_check_cpu_first(windows.begin(), windows.end());
+    ASSERT(windows[0].feasible_sets.size() == 1);
+    const auto& first = windows[0].feasible_sets[0];
+    ASSERT(first.divisor_indices.size() == 2);
+    ASSERT(first.divisor_indices[0] == 3 && first.divisor_indices[1] == 4);
+    ASSERT(first.window_id == 7);
+    ASSERT(windows[1].feasible_sets.empty());
+    std::cout << "✓ FIRST mode finds the smallest feasible set\n";
+}
+
+void test_feasibility_cache() {
+    std::cout << "\n=== TESTING CROSS-WINDOW FEASIBILITY CACHE ===\n";
+    
+    const uint64_t A = 0xaaaaaaaaaaaaaaaaull;
+    const uint64_t B = 0xccccccccccccccccull;
+    const uint64_t C = 0xf0f0f0f0f0f0f0f0ull;
+    const uint64_t D = 0xff00ff00ff00ff00ull;
+    // Same function with divisors permuted, then a different function
+    std::vector<Window> windows(3);
+    for (auto& w : windows) w.inputs = {1, 2, 3, 4};
+    windows[0].truth_tables = { {A}, {B}, {C}, {D}, {(A & B) ^ C} };
+    windows[1].truth_tables = { {D}, {C}, {A}, {B}, {(A & B) ^ C} };
+    windows[2].truth_tables = { {D}, {C}, {A}, {B}, {(A | B) ^ C} };
+    for (int i = 0; i < 3; i++) windows[i].cut_id = i;
+    
+    FeasibilityCache cache;
+    feasibility_check_cached(windows.begin(), windows.end(), cache, feasibility_check_cpu_all);
+    ASSERT(cache.hits == 1);
+    ASSERT(cache.misses == 2);
+    
+    // The hit must match a direct check of the same window
+    std::vector<Window> direct(windows.begin() + 1, windows.begin() + 2);
+    direct[0].feasible_sets.clear();
+    feasibility_check_cpu_all(direct.begin(), direct.end());
+    auto sorted_ranks = [](const std::vector<FeasibleSet>& sets) {
+        std::vector<uint64_t> ranks;
+        for (const auto& fs : sets) ranks.push_back(combination_rank(fs.divisor_indices));
+        std::sort(ranks.begin(), ranks.end());
+        return ranks;
+    };
+    ASSERT(!windows[1].feasible_sets.empty());
+    ASSERT(sorted_ranks(windows[1].feasible_sets) == sorted_ranks(direct[0].feasible_sets));
+    ASSERT(windows[1].feasible_sets[0].window_id == 1);
+    std::cout << "✓ Cached results mapped back to the window's divisor order\n";
+}
+
+void test_window_cache_roundtrip() {
+    std::cout << "\n=== TESTING PERSISTENT WINDOW CACHE ===\n";
+    
+    aigman aig(3, 1);
+    aig.vObjs.resize(9 * 2);
+    aig.vObjs[4 * 2] = 2;  aig.vObjs[4 * 2 + 1] = 4;   // 4 = AND(1, 2)
+    aig.vObjs[5 * 2] = 4;  aig.vObjs[5 * 2 + 1] = 6;   // 5 = AND(2, 3)
+    aig.vObjs[6 * 2] = 8;  aig.vObjs[6 * 2 + 1] = 10;  // 6 = AND(4, 5)
+    aig.vObjs[7 * 2] = 8;  aig.vObjs[7 * 2 + 1] = 6;   // 7 = AND(4, 3)
+    aig.vObjs[8 * 2] = 12; aig.vObjs[8 * 2 + 1] = 14;  // 8 = AND(6, 7)
+    aig.nGates = 5;
+    aig.nObjs = 9;
+    aig.vPos[0] = 16;
+    
+    std::vector<Window> windows;
+    window_extract_all(aig, 4, false, windows);
+    for (auto& w : windows) w.truth_tables = compute_truth_tables_for_window(aig, w, false);
+    feasibility_check_cpu_min(windows.begin(), windows.end());
+    
+    std::string path = "test_window_cache.bin";
+    std::remove(path.c_str());
+    {
+        WindowCache cache;
+        ASSERT(cache.open(path));
+        for (auto& w : windows) {
+            ASSERT(!cache.lookup(w, 0));
+            cache.append(w, 0);
+        }
+    }
+    {
+        // Simulate an interrupted append: the partial tail record is dropped
+        std::ofstream tail(path, std::ios::binary | std::ios::app);
+        tail.write("\x40\0\0\0\0\0\0\0partial", 15);
+    }
+    WindowCache cache;
+    ASSERT(cache.open(path));
+    std::vector<Window> fresh;
+    window_extract_all(aig, 4, false, fresh);
+    bool all_match = fresh.size() == windows.size();
+    for (size_t i = 0; all_match && i < fresh.size(); i++) {
+        if (!cache.lookup(fresh[i], 0)) { all_match = false; break; }
+        all_match = fresh[i].truth_tables == windows[i].truth_tables &&
+                    fresh[i].feasible_sets.size() == windows[i].feasible_sets.size();
+        for (size_t j = 0; all_match && j < fresh[i].feasible_sets.size(); j++) {
+            const auto& a = fresh[i].feasible_sets[j].divisor_indices;
+            const auto& b = windows[i].feasible_sets[j].divisor_indices;
+            all_match = std::equal(a.begin(), a.end(), b.begin(), b.end());
+        }
+    }
+    ASSERT(all_match);
+    ASSERT(cache.misses == 0);
+    // Other modes do not share records
+    ASSERT(!cache.lookup(fresh[0], 1));
+    std::remove(path.c_str());
+    std::cout << "✓ Cached windows restored after reopening\n";
+
+    // Virtual-divisor results (mode 3) depend on the MFFC size
+    Window* with_set = nullptr;
+    for (auto& w : windows) {
+        if (!w.feasible_sets.empty() && !w.feasible_sets.back().divisor_indices.empty()) with_set = &w;
+    }
+    ASSERT(with_set != nullptr);
+    {
+        WindowCache writer;
+        ASSERT(writer.open(path));
+        writer.append(*with_set, 3);
+    }
+    {
+        WindowCache reader;
+        ASSERT(reader.open(path));
+        Window probe = *with_set;
+        probe.mffc_size += 1;
+        ASSERT(!reader.lookup(probe, 3));
+        probe.mffc_size -= 1;
+        ASSERT(reader.lookup(probe, 3));
+    }
+    {
+        // A divisor index out of range makes the record a miss: patch idx[0]
+        // of the last feasible set (the last 8 bytes are idx[0..3])
+        std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out);
+        f.seekp(-8, std::ios::end);
+        f.write("\xff\xff", 2);
+    }
+    {
+        WindowCache reader;
+        ASSERT(reader.open(path));
+        Window probe = *with_set;
+        ASSERT(!reader.lookup(probe, 3));
+        ASSERT(probe.feasible_sets.empty() && probe.truth_tables.empty());
+    }
+    std::remove(path.c_str());
+    std::cout << "✓ Mode 3 keyed on MFFC size; out-of-range records rejected\n";
+}
+
+void test_feasibility_with_care() {
+    std::cout << "\n=== TESTING FEASIBILITY WITH A CARE MASK ===\n";
+    
+    const uint64_t A = 0xaaaaaaaaaaaaaaaaull;
+    const uint64_t B = 0xccccccccccccccccull;
+    std::vector<std::vector<uint64_t>> tts = { {A}, {B}, {A & B} };
+    uint64_t care = A;  // target observable only when A = 1
+    
+    ASSERT(!solve_resub_overlap_multiword_1(1, tts, 2));
+    ASSERT(solve_resub_overlap_multiword_1(1, tts, 2, &care));
+    ASSERT(!solve_resub_overlap_multiword_0(tts, 2, &care));
+    uint64_t no_care = 0;
+    ASSERT(solve_resub_overlap_multiword_0(tts, 2, &no_care));
+    
+    std::vector<Window> windows(1);
+    windows[0].inputs = {1, 2};
+    windows[0].cut_id = 0;
+    windows[0].truth_tables = tts;
+    windows[0].care = {care};
+    feasibility_check_cpu_min(windows.begin(), windows.end());
+    ASSERT(windows[0].feasible_sets.size() == 1);
+    ASSERT(!windows[0].feasible_sets.empty() && windows[0].feasible_sets[0].divisor_indices[0] == 1);
+    std::cout << "✓ Care masks relax the feasibility kernels\n";
+}
+
+void test_double_divisor_resub() {
+    std::cout << "\n=== TESTING DOUBLE DIVISOR RESUB ===\n";
+    
+    const uint64_t A = 0xaaaaaaaaaaaaaaaaull;
+    const uint64_t B = 0xccccccccccccccccull;
+    const uint64_t C = 0xf0f0f0f0f0f0f0f0ull;
+    const uint64_t D = 0xff00ff00ff00ff00ull;
+    const uint64_t E = 0xffff0000ffff0000ull;
+    // Target = (A & !B) | (C & D): two double divisors and one OR
+    std::vector<std::vector<uint64_t>> tts = { {E}, {A}, {B}, {C}, {D}, {(A & ~B) | (C & D)} };
+    std::vector<FeasibleSet> sets;
+    ASSERT(find_feasible_double_divisor_resub(tts, 5, sets) == 1);
+    ASSERT(sets.size() == 1);
+    if (sets.size() == 1) {
+        const FeasibleSet& fs = sets[0];
+        ASSERT(fs.divisor_indices.size() == 4 && fs.divisor_indices[0] == 1 && fs.divisor_indices[3] == 4);
+        ASSERT(fs.synth != nullptr && fs.synth->nGates == 3);
+        // Simulate the structure on the divisor truth tables
+        std::vector<uint64_t> values(fs.synth->nObjs, 0);
+        for (int i = 0; i < 4; i++) values[i + 1] = tts[fs.divisor_indices[i]][0];
+        auto lit_value = [&values](int lit) { return values[lit >> 1] ^ ((lit & 1) ? ~0ull : 0); };
+        for (int n = fs.synth->nPis + 1; n < fs.synth->nObjs; n++) {
+            values[n] = lit_value(fs.synth->vObjs[2 * n]) & lit_value(fs.synth->vObjs[2 * n + 1]);
+        }
+        ASSERT(lit_value(fs.synth->vPos[0]) == tts.back()[0]);
+    }
+    for (auto& fs : sets) delete fs.synth;
+    
+    // (A ^ B) | (C & D) is feasible on {A, B, C, D} but needs an XOR
+    tts.back() = {(A ^ B) | (C & D)};
+    sets.clear();
+    ASSERT(solve_resub_overlap_multiword(1, 2, 3, 4, tts, 5));
+    ASSERT(find_feasible_double_divisor_resub(tts, 5, sets) == 0);
+    
+    std::vector<Window> windows(1);
+    windows[0].inputs = {1, 2, 3, 4, 5};
+    windows[0].cut_id = 3;
+    windows[0].mffc_size = 5;
+    windows[0].truth_tables = { {E}, {A}, {B}, {C}, {D}, {(A & ~B) | (C & D)} };
+    feasibility_check_cpu_min_virtual(windows.begin(), windows.end());
+    ASSERT(windows[0].feasible_sets.size() == 1);
+    for (auto& fs : windows[0].feasible_sets) {
+        ASSERT(fs.synth != nullptr && fs.window_id == 3);
+        delete fs.synth;
+    }
+    std::cout << "✓ Double divisors turn AND/OR of pairs into 3-gate structures\n";
+}
+
 int main() {
     std::cout << "========================================\n";
     std::cout << "       FEASIBILITY TEST SUITE          \n";
@@ -354,6 +739,14 @@ int main() {
     test_small_k_helpers_and_enumerators();
     test_feasibility_with_aigman(); 
     test_find_feasible_4resub();
+    test_combination_rank_and_bitmap();
+    test_feasible_visitor();
+    test_find_feasible_best_n();
+    test_feasibility_first_mode();
+    test_feasibility_cache();
+    test_window_cache_roundtrip();
+    test_feasibility_with_care();
+    test_double_divisor_resub();
     
     std::cout << "========================================\n";
     std::cout << "         TEST RESULTS SUMMARY          \n";
@@ -1,9 +1,19 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
 
 #include <aig.hpp>
 
+#include "aig_utils.hpp"
+#include "candidates.hpp"
 #include "insertion.hpp"
+#include "journal.hpp"
+#include "partition.hpp"
+#include "simulation.hpp"
+#include "spill.hpp"
 #include "window.hpp"
 
 int total_tests = 0;
@@ -189,7 +199,7 @@ void test_heap_based_insertion() {
             synth_aig->nGates = 1;
             synth_aig->nObjs = 4;
             synth_aig->vPos[0] = 6;
-            fs.synths.push_back(synth_aig);
+            fs.synth = synth_aig;
             w.feasible_sets.push_back(std::move(fs));
             fabricated++;
         }
@@ -206,6 +216,438 @@ void test_heap_based_insertion() {
               << " to " << aig.nGates << "\n";
 }
 
+void test_partition_stitch() {
+    std::cout << "\n=== TESTING PARTITION AND STITCH ===\n";
+    
+    // Random AIG with several POs
+    aigman aig(12, 4);
+    uint32_t state = 777;
+    auto next = [&state]() { state = state * 1103515245u + 12345u; return state >> 8; };
+    for (int i = 0; i < 400; i++) {
+        int a = 1 + next() % (aig.nObjs - 1);
+        int b = 1 + next() % (aig.nObjs - 1);
+        if (a == b) continue;
+        aig.newgate(2 * a + (next() & 1), 2 * b + (next() & 1));
+    }
+    for (int k = 0; k < 4; k++) aig.vPos[k] = 2 * (aig.nObjs - 1 - 7 * k) + (k & 1);
+    
+    const int num_words = 4;
+    std::vector<uint64_t> reference = simulate_aig_random(aig, num_words, 1);
+    auto po_values = [num_words](const aigman& g, const std::vector<uint64_t>& sim) {
+        std::vector<uint64_t> values;
+        for (int po : g.vPos) {
+            for (int w = 0; w < num_words; w++) values.push_back(sim[(po >> 1) * num_words + w] ^ ((po & 1) ? ~0ull : 0));
+        }
+        return values;
+    };
+    std::vector<uint64_t> expected = po_values(aig, reference);
+    
+    for (PartitionMode mode : {PartitionMode::LEVELS, PartitionMode::CONES}) {
+        std::vector<Partition> parts = partition_aig(aig, 50, mode);
+        ASSERT(parts.size() > 1);
+        // Regions are bounded and only read PIs or earlier regions
+        std::vector<int> region(aig.nObjs, -1);
+        bool ordered = true;
+        for (size_t r = 0; r < parts.size(); r++) {
+            ordered &= parts[r].gates.size() <= 50;
+            for (int gate : parts[r].gates) region[gate] = static_cast<int>(r);
+            for (int input : parts[r].inputs) ordered &= input <= aig.nPis || (region[input] >= 0 && region[input] < static_cast<int>(r));
+        }
+        ASSERT(ordered);
+        
+        aigman copy = aig;
+        int regions = optimize_partitioned(copy, 50, mode, 4, [](aigman& sub) { (void)sub; });
+        ASSERT(regions == static_cast<int>(parts.size()));
+        ASSERT(copy.nPis == aig.nPis && copy.nPos == aig.nPos);
+        ASSERT(copy.nGates <= aig.nGates);
+        ASSERT(po_values(copy, simulate_aig_random(copy, num_words, 1)) == expected);
+    }
+    std::cout << "✓ Stitched regions preserve the PO functions\n";
+}
+
+void test_candidate_file_roundtrip() {
+    std::cout << "\n=== TESTING CANDIDATE FILE ROUNDTRIP ===\n";
+    
+    // Node 5 = AND(1, 2), 6 = AND(3, 4), 7 = AND(5, 6), 8 = AND(5, 3), 9 = AND(7, 8)
+    aigman aig(4, 1);
+    aig.vObjs.resize(10 * 2);
+    aig.vObjs[5 * 2] = 2;  aig.vObjs[5 * 2 + 1] = 4;
+    aig.vObjs[6 * 2] = 6;  aig.vObjs[6 * 2 + 1] = 8;
+    aig.vObjs[7 * 2] = 10; aig.vObjs[7 * 2 + 1] = 12;
+    aig.vObjs[8 * 2] = 10; aig.vObjs[8 * 2 + 1] = 6;
+    aig.vObjs[9 * 2] = 14; aig.vObjs[9 * 2 + 1] = 16;
+    aig.nGates = 5;
+    aig.nObjs = 10;
+    aig.vPos[0] = 18;
+    
+    // Every cut ID lands in exactly one shard
+    bool partitioned = true;
+    for (int id = 0; id < 100; id++) {
+        int owners = 0;
+        for (int shard = 0; shard < 3; shard++) owners += in_shard(id, shard, 3);
+        partitioned &= owners == 1;
+    }
+    ASSERT(partitioned);
+    
+    std::vector<Window> windows;
+    window_extract_all(aig, 4, false, windows);
+    int chosen = -1;
+    for (size_t i = 0; i < windows.size() && chosen < 0; i++) {
+        if (windows[i].divisors.size() >= 2) chosen = static_cast<int>(i);
+    }
+    ASSERT(chosen >= 0);
+    if (chosen < 0) return;
+    Window& w = windows[chosen];
+    FeasibleSet fs;
+    fs.window_id = w.cut_id;
+    fs.divisor_indices = {0, 1};
+    fs.synth = new aigman(2, 1);
+    fs.synth->vPos[0] = 2 * fs.synth->newgate(2, 5) + 1;
+    w.feasible_sets.push_back(fs);
+    w.care.assign(70000, 0x5555555555555555ull);  // more words than a u16 count holds
+    w.local.flags[0] |= WindowSnapshot::ODC;
+    
+    const std::string path = "test_candidates.bin";
+    uint64_t fingerprint = candidate_fingerprint(aig, 4);
+    ASSERT(write_candidates(path, fingerprint, windows));
+    delete fs.synth;
+    
+    std::vector<Window> loaded;
+    window_extract_all(aig, 4, false, loaded);
+    ASSERT(read_candidates(path, fingerprint + 1, loaded) == -1);
+    ASSERT(read_candidates(path, fingerprint, loaded) == 1);
+    const Window& r = loaded[chosen];
+    ASSERT(r.feasible_sets.size() == 1);
+    ASSERT(r.care == w.care);
+    ASSERT(r.local.flags[0] & WindowSnapshot::ODC);
+    if (r.feasible_sets.size() == 1) {
+        const FeasibleSet& got = r.feasible_sets[0];
+        ASSERT(got.window_id == w.cut_id);
+        ASSERT(got.divisor_indices.size() == 2 && got.divisor_indices[1] == 1);
+        ASSERT(got.synth && got.synth->nGates == 1 && got.synth->vPos[0] == 7);
+        ASSERT(got.synth && got.synth->vObjs[6] == 2 && got.synth->vObjs[7] == 5);
+        delete got.synth;
+    }
+    std::remove(path.c_str());
+    std::cout << "✓ Candidates survive a write/read roundtrip\n";
+}
+
+// Two independent redundant cones, AND(AND(a,b), a) == AND(a,b), with
+// `copies` candidates per cone replacing its root by AND of its two PIs
+static int build_disjoint_cones(aigman& aig, std::vector<Window>& windows, int copies) {
+    aig = aigman(4, 2);
+    aig.vObjs.resize(9 * 2);
+    aig.vObjs[5 * 2] = 2;  aig.vObjs[5 * 2 + 1] = 4;   // 5 = AND(1, 2)
+    aig.vObjs[6 * 2] = 10; aig.vObjs[6 * 2 + 1] = 2;   // 6 = AND(5, 1)
+    aig.vObjs[7 * 2] = 6;  aig.vObjs[7 * 2 + 1] = 8;   // 7 = AND(3, 4)
+    aig.vObjs[8 * 2] = 14; aig.vObjs[8 * 2 + 1] = 6;   // 8 = AND(7, 3)
+    aig.nGates = 4;
+    aig.nObjs = 9;
+    aig.vPos[0] = 12;
+    aig.vPos[1] = 16;
+
+    windows.clear();
+    window_extract_all(aig, 4, false, windows);
+
+    int fabricated = 0;
+    for (auto& w : windows) {
+        if (w.target_node != 6 && w.target_node != 8) continue;
+        int pi0 = w.target_node == 6 ? 1 : 3;
+        for (int c = 0; c < copies; c++) {
+            FeasibleSet fs;
+            for (size_t i = 0; i < w.divisors.size(); i++) {
+                if (w.divisors[i] == pi0 || w.divisors[i] == pi0 + 1) fs.divisor_indices.push_back(static_cast<int>(i));
+            }
+            if (fs.divisor_indices.size() != 2 || w.mffc_size != 2) continue;
+            aigman* synth_aig = new aigman(2, 1);
+            synth_aig->vObjs.resize(4 * 2);
+            synth_aig->vObjs[3 * 2] = 2;
+            synth_aig->vObjs[3 * 2 + 1] = 4;
+            synth_aig->nGates = 1;
+            synth_aig->nObjs = 4;
+            synth_aig->vPos[0] = 6;
+            fs.synth = synth_aig;
+            w.feasible_sets.push_back(std::move(fs));
+            fabricated++;
+        }
+    }
+    return fabricated;
+}
+
+// Outputs still compute AND(1,2) and AND(3,4)
+static bool outputs_are_pi_ands(const aigman& aig) {
+    std::vector<int> lit_val(aig.nObjs);
+    bool ok = true;
+    for (int m = 0; m < 16; m++) {
+        for (int i = 1; i <= 4; i++) lit_val[i] = (m >> (i - 1)) & 1;
+        std::function<int(int)> eval = [&](int lit) {
+            int node = lit >> 1;
+            int v = node == 0 ? 0 : node <= aig.nPis ? lit_val[node]
+                  : eval(aig.vObjs[node * 2]) & eval(aig.vObjs[node * 2 + 1]);
+            return v ^ (lit & 1);
+        };
+        ok = ok && eval(aig.vPos[0]) == (lit_val[1] & lit_val[2]);
+        ok = ok && eval(aig.vPos[1]) == (lit_val[3] & lit_val[4]);
+    }
+    return ok;
+}
+
+void test_disjoint_candidates_reuse() {
+    std::cout << "\n=== TESTING DISJOINT CANDIDATES AFTER IMPORT ===\n";
+
+    aigman aig;
+    std::vector<Window> windows;
+    ASSERT(build_disjoint_cones(aig, windows, 1) == 2);
+
+    // The second candidate is untouched by the first import and must still apply
+    int applied = inserter_process_windows_heap(aig, windows, true);
+    ASSERT(applied == 2);
+    ASSERT(aig.nGates == 2);
+    ASSERT(outputs_are_pi_ands(aig));
+    std::cout << "✓ Both disjoint candidates applied, outputs preserved\n";
+}
+
+void test_batched_insertion() {
+    std::cout << "\n=== TESTING BATCHED INSERTION ===\n";
+
+    // Two candidates per target: within a batch, the second one of each target
+    // must be re-checked after the first commits and then skipped
+    for (int batch : {1, 2, 8, -2, -8}) {
+        // Negative: speculative batches of that size
+        aigman aig;
+        std::vector<Window> windows;
+        ASSERT(build_disjoint_cones(aig, windows, 2) == 4);
+        int applied = inserter_process_windows_heap(aig, windows, false, std::abs(batch), 2, batch < 0);
+        ASSERT(applied == 2);
+        ASSERT(aig.nGates == 2);
+        ASSERT(outputs_are_pi_ands(aig));
+        for (auto& w : windows) {
+            for (auto& fs : w.feasible_sets) delete fs.synth;
+        }
+        std::cout << "✓ Batch size " << std::abs(batch) << (batch < 0 ? " (speculative)" : "") << ": " << applied << " applied, " << aig.nGates << " gates\n";
+    }
+}
+
+void test_journal_rollback() {
+    std::cout << "\n=== TESTING JOURNALED REPLACEMENT AND ROLLBACK ===\n";
+
+    aigman aig;
+    std::vector<Window> windows;
+    build_disjoint_cones(aig, windows, 0);
+    aig.supportfanouts();
+    auto objs = aig.vObjs;
+    auto pos = aig.vPos;
+    auto fanouts = aig.vvFanouts;
+    int gates = aig.nGates;
+    int nobjs = aig.nObjs;
+
+    // AND(1,2) over divisors {1,2} replaces node 6 (PO 0); AND(3,4) node 8
+    aigman synth(2, 1);
+    synth.vObjs.resize(4 * 2);
+    synth.vObjs[3 * 2] = 2;
+    synth.vObjs[3 * 2 + 1] = 4;
+    synth.nGates = 1;
+    synth.nObjs = 4;
+    synth.vPos[0] = 6;
+
+    AigJournal journal(aig);
+    ASSERT(journal.replace(synth, {1, 2}, 6) == 1);
+    ASSERT(journal.replace(synth, {3, 4}, 8) == 1);
+    ASSERT(aig.nGates == 2);
+    ASSERT(journal.changes() > 0);
+    ASSERT(outputs_are_pi_ands(aig));
+
+    journal.rollback();
+    ASSERT(journal.changes() == 0);
+    ASSERT(aig.nGates == gates && aig.nObjs == nobjs);
+    ASSERT(std::equal(pos.begin(), pos.end(), aig.vPos.begin()));
+    ASSERT(std::equal(objs.begin(), objs.begin() + 2 * nobjs, aig.vObjs.begin()));
+    ASSERT(aig.vvFanouts == fanouts);
+    bool all_alive = true;
+    for (int i = 0; i < aig.nObjs; i++) all_alive = all_alive && is_node_accessible(aig, i);
+    ASSERT(all_alive);
+
+    // Committed changes survive a later rollback
+    ASSERT(journal.replace(synth, {1, 2}, 6) == 1);
+    journal.commit();
+    ASSERT(journal.replace(synth, {3, 4}, 8) == 1);
+    journal.rollback();
+    ASSERT(aig.nGates == 3);
+    ASSERT(!is_node_accessible(aig, 6) && is_node_accessible(aig, 8));
+    ASSERT(outputs_are_pi_ands(aig));
+    std::cout << "✓ Rollback restored the AIG exactly; committed replacement kept\n";
+}
+
+void test_tiny_circuit_rewrite() {
+    std::cout << "\n=== TESTING TINY CIRCUIT IN-PLACE REWRITE ===\n";
+
+    aigman aig;
+    std::vector<Window> windows;
+    build_disjoint_cones(aig, windows, 0);
+    aig.supportfanouts();
+
+    // Node 6 = AND(AND(1,2), 1) is node 5 itself: a 0-gate replacement
+    aigman buffer(1, 1);
+    buffer.vPos[0] = 2;
+    TinyCircuit tiny;
+    ASSERT(TinyCircuit::from_aig(buffer, tiny));
+    ASSERT(tiny.num_inputs == 1 && tiny.num_gates == 0 && tiny.output == 2);
+
+    AigJournal journal(aig);
+    ASSERT(journal.replace(tiny, {5}, 6) == 1);
+    journal.commit();
+    ASSERT(aig.vPos[0] == 10);
+    ASSERT(aig.nGates == 3);
+    ASSERT(outputs_are_pi_ands(aig));
+
+    // Too many gates for the inline form
+    aigman chain(2, 1);
+    for (int i = 0; i < 4; i++) chain.newgate(2, i == 0 ? 4 : 2 * (chain.nObjs - 1));
+    chain.vPos[0] = 2 * (chain.nObjs - 1);
+    ASSERT(!TinyCircuit::from_aig(chain, tiny));
+    std::cout << "✓ 0-gate replacement rewired the PO in place\n";
+
+    // Replacements that need simplification are refused, leaving the AIG as is
+    build_disjoint_cones(aig, windows, 0);
+    aig.supportfanouts();
+    auto objs = aig.vObjs;
+    AigJournal refusing(aig);
+    // Node 5 by PI 1: node 6 = AND(5, 1) would become AND(1, 1)
+    ASSERT(TinyCircuit::from_aig(buffer, tiny));
+    ASSERT(refusing.replace(tiny, {1}, 5) == -1);
+    // Node 8 by constant 0
+    aigman zero(0, 1);
+    zero.vPos[0] = 0;
+    ASSERT(TinyCircuit::from_aig(zero, tiny));
+    ASSERT(refusing.replace(tiny, {}, 8) == -1);
+    ASSERT(refusing.changes() == 0);
+    ASSERT(aig.nGates == 4 && aig.vObjs == objs);
+    std::cout << "✓ Constant and AND(d, d) replacements left to aig.import\n";
+}
+
+void test_consolidate_candidates() {
+    std::cout << "\n=== TESTING CANDIDATE CONSOLIDATION BY TARGET ===\n";
+
+    // Target 10: two windows (3-divisor and 1-divisor sets) plus a bitmap of
+    // three 2-divisor sets; target 11 has a single set
+    std::vector<Window> windows(3);
+    for (int w = 0; w < 3; w++) {
+        windows[w].cut_id = w;
+        windows[w].target_node = w < 2 ? 10 : 11;
+        windows[w].mffc_size = 4;
+    }
+    FeasibleSet three;
+    three.divisor_indices = {0, 1, 2};
+    FeasibleSet one;
+    one.divisor_indices = {3};
+    windows[0].feasible_sets = {three, one};
+    windows[1].feasible_k = 2;
+    windows[1].feasible_bitmap = {0x13};  // ranks 0, 1 and 4
+    windows[2].feasible_sets = {one};
+
+    size_t dropped = consolidate_candidates(windows, 2);
+    // Target 10 keeps the 1-divisor set (gain 4) and bitmap rank 0 (gain 3)
+    ASSERT(dropped == 3);
+    ASSERT(windows[0].feasible_sets.size() == 1);
+    ASSERT(windows[0].feasible_sets[0].divisor_indices.size() == 1);
+    ASSERT(windows[1].feasible_bitmap.size() == 1 && windows[1].feasible_bitmap[0] == 0x1);
+    ASSERT(windows[2].feasible_sets.size() == 1);
+    std::cout << "✓ Kept the 2 most promising sets of target 10, dropped " << dropped << "\n";
+}
+
+void test_spill_file() {
+    std::cout << "\n=== TESTING SPILL FILE ===\n";
+    
+    aigman aig;
+    std::vector<Window> windows;
+    int fabricated = build_disjoint_cones(aig, windows, 2);
+    ASSERT(fabricated > 0);
+    std::vector<Window> reference = windows;
+    for (auto& w : reference) for (auto& fs : w.feasible_sets) fs.synth = new aigman(*fs.synth);
+    
+    // Batches of one window each, spilled and dropped from memory
+    SpillFile spill;
+    ASSERT(spill.open("."));
+    std::vector<SpillFile::Segment> segments(windows.size());
+    for (size_t i = 0; i < windows.size(); i++) {
+        ASSERT(spill.append(windows.begin() + i, windows.begin() + i + 1, segments[i]));
+        for (auto& fs : windows[i].feasible_sets) delete fs.synth;
+    }
+    windows.clear();
+    ASSERT(spill.size() > 0);
+    int loaded = 0;
+    for (const auto& segment : segments) loaded += spill.load(segment, windows);
+    ASSERT(loaded == fabricated && windows.size() == reference.size());
+    bool same = windows.size() == reference.size();
+    for (size_t i = 0; same && i < windows.size(); i++) {
+        const Window& got_w = windows[i];
+        const Window& want_w = reference[i];
+        same &= got_w.target_node == want_w.target_node && got_w.cut_id == want_w.cut_id &&
+                got_w.mffc_size == want_w.mffc_size && got_w.inputs == want_w.inputs &&
+                got_w.nodes == want_w.nodes && got_w.divisors == want_w.divisors &&
+                got_w.local.fanins == want_w.local.fanins && got_w.local.flags == want_w.local.flags &&
+                got_w.local.fanout_indices == want_w.local.fanout_indices && got_w.local.target == want_w.local.target &&
+                got_w.truth_tables.empty();
+        same &= windows[i].feasible_sets.size() == reference[i].feasible_sets.size();
+        for (size_t s = 0; same && s < windows[i].feasible_sets.size(); s++) {
+            const FeasibleSet& got = windows[i].feasible_sets[s];
+            const FeasibleSet& want = reference[i].feasible_sets[s];
+            same &= got.window_id == windows[i].cut_id && got.synth && got.synth->nObjs == want.synth->nObjs &&
+                    std::equal(want.synth->vObjs.begin(), want.synth->vObjs.begin() + 2 * want.synth->nObjs,
+                               got.synth->vObjs.begin()) &&
+                    got.synth->vPos == want.synth->vPos &&
+                    std::equal(got.divisor_indices.begin(), got.divisor_indices.end(), want.divisor_indices.begin());
+        }
+    }
+    ASSERT(same);
+    
+    // Spilled candidates insert like in-memory ones
+    aigman spilled = aig;
+    int resubs = inserter_process_windows_heap(spilled, windows, false);
+    int expected = inserter_process_windows_heap(aig, reference, false);
+    ASSERT(resubs == expected && spilled.nGates == aig.nGates);
+    for (auto& w : windows) for (auto& fs : w.feasible_sets) delete fs.synth;
+    for (auto& w : reference) for (auto& fs : w.feasible_sets) delete fs.synth;
+    std::cout << "✓ Spilled candidates load back and insert like in-memory ones\n";
+}
+
+void test_spill_file_sharded() {
+    std::cout << "\n=== TESTING SPILL FILE WITH SHARDED WINDOWS ===\n";
+    
+    // Keep only the shard of the last candidate window, like --shard does:
+    // surviving cut IDs are sparse and exceed the number of windows
+    aigman aig;
+    std::vector<Window> windows;
+    build_disjoint_cones(aig, windows, 1);
+    int shard = -1;
+    for (const auto& w : windows) {
+        if (!w.feasible_sets.empty()) shard = in_shard(w.cut_id, 0, 3) ? 0 : in_shard(w.cut_id, 1, 3) ? 1 : 2;
+    }
+    int kept = 0;
+    bool sparse = false;
+    std::vector<Window> sharded;
+    for (auto& w : windows) {
+        if (!in_shard(w.cut_id, shard, 3)) {
+            for (auto& fs : w.feasible_sets) delete fs.synth;
+            continue;
+        }
+        kept += static_cast<int>(w.feasible_sets.size());
+        sharded.push_back(std::move(w));
+    }
+    for (const auto& w : sharded) sparse |= !w.feasible_sets.empty() && w.cut_id >= static_cast<int>(sharded.size());
+    ASSERT(kept > 0 && sparse);
+    
+    SpillFile spill;
+    SpillFile::Segment segment;
+    ASSERT(spill.open("."));
+    ASSERT(spill.append(sharded.begin(), sharded.end(), segment));
+    for (auto& w : sharded) for (auto& fs : w.feasible_sets) delete fs.synth;
+    std::vector<Window> loaded;
+    ASSERT(spill.load(segment, loaded) == kept && loaded.size() == sharded.size());
+    for (auto& w : loaded) for (auto& fs : w.feasible_sets) delete fs.synth;
+    std::cout << "✓ Candidates of a shard's windows load back by cut ID\n";
+}
+
 int main() {
     std::cout << "========================================\n";
     std::cout << "        INSERTION TEST SUITE           \n";
@@ -213,6 +655,15 @@ int main() {
     
     test_aigman_import();
     test_heap_based_insertion();
+    test_disjoint_candidates_reuse();
+    test_batched_insertion();
+    test_journal_rollback();
+    test_tiny_circuit_rewrite();
+    test_partition_stitch();
+    test_candidate_file_roundtrip();
+    test_consolidate_candidates();
+    test_spill_file();
+    test_spill_file_sharded();
     
     std::cout << "========================================\n";
     std::cout << "         TEST RESULTS SUMMARY          \n";
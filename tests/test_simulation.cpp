@@ -1,9 +1,16 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <thread>
 
 #include <aig.hpp>
 
+#include "arena.hpp"
+#include "numa.hpp"
 #include "simulation.hpp"
+#include "truth_table_store.hpp"
 #include "window.hpp"
 
 int total_tests = 0;
@@ -106,6 +113,232 @@ void test_truth_table_computation() {
     std::cout << "Target truth table (first word): 0x" << std::hex << results[5][0] << std::dec << "\n";
     
     std::cout << "✓ Complex truth table computation working\n";
+
+    // Test 3: extracted windows simulate on their local snapshot and must
+    // match the same window rebuilt by hand (snapshot built on the fly)
+    std::cout << "\nTest 3: Extracted windows vs hand-built windows\n";
+    std::vector<fresub::Window> windows;
+    fresub::window_extract_all(aig, 4, false, windows);
+    ASSERT(!windows.empty());
+    for (const auto& w : windows) {
+        fresub::Window copy;
+        copy.target_node = w.target_node;
+        copy.inputs = w.inputs;
+        copy.nodes = w.nodes;
+        copy.divisors = w.divisors;
+        ASSERT(fresub::compute_truth_tables_for_window(aig, w, false) ==
+               fresub::compute_truth_tables_for_window(aig, copy, false));
+    }
+    std::cout << "✓ Snapshot-based simulation matches\n";
+}
+
+void test_window_care() {
+    std::cout << "\n=== TESTING ODC CARE MASKS ===\n";
+    
+    // Node 3 = AND(1, 2) is observed only through PO node 4 = AND(3, 1):
+    // whenever input 1 is 0 the target value does not matter
+    aigman aig(2, 1);
+    aig.vObjs.resize(5 * 2);
+    aig.vObjs[3 * 2] = 2;
+    aig.vObjs[3 * 2 + 1] = 4;
+    aig.vObjs[4 * 2] = 6;
+    aig.vObjs[4 * 2 + 1] = 2;
+    aig.nGates = 2;
+    aig.nObjs = 5;
+    aig.vPos[0] = 8;
+    
+    std::vector<fresub::Window> windows;
+    fresub::window_extract_all(aig, 4, false, windows);
+    fresub::Window* window = nullptr;
+    for (auto& w : windows) {
+        if (w.target_node == 3 && w.inputs == std::vector<int>{1, 2}) window = &w;
+    }
+    ASSERT(window != nullptr);
+    if (!window) return;
+    
+    fresub::compute_window_care(*window, 0);
+    ASSERT(window->care.empty());
+    fresub::compute_window_care(*window, 1);
+    ASSERT(window->care.size() == 1);
+    ASSERT(!window->care.empty() && window->care[0] == 0xaaaaaaaaaaaaaaaaull);
+    ASSERT(window->local.flags[window->local.target] & fresub::WindowSnapshot::ODC);
+    
+    // The root itself keeps its function
+    int root = -1;
+    for (size_t i = 0; i < window->nodes.size(); i++) {
+        if (window->nodes[i] == 4) root = static_cast<int>(i);
+    }
+    ASSERT(root >= 0 && !(window->local.flags[root] & fresub::WindowSnapshot::ODC));
+    std::cout << "✓ Care mask derived from the window TFO\n";
+}
+
+void test_window_sdc() {
+    std::cout << "\n=== TESTING SDC CARE MASKS ===\n";
+    
+    // Leaves 3 = AND(1, 2) and 4 = AND(1, !2) are never 1 together
+    aigman aig(2, 1);
+    aig.vObjs.resize(6 * 2);
+    aig.vObjs[3 * 2] = 2;
+    aig.vObjs[3 * 2 + 1] = 4;
+    aig.vObjs[4 * 2] = 2;
+    aig.vObjs[4 * 2 + 1] = 5;
+    aig.vObjs[5 * 2] = 6;
+    aig.vObjs[5 * 2 + 1] = 8;
+    aig.nGates = 3;
+    aig.nObjs = 6;
+    aig.vPos[0] = 10;
+    
+    std::vector<fresub::Window> windows;
+    fresub::window_extract_all(aig, 4, false, windows);
+    fresub::SdcStats stats = fresub::compute_window_sdc(aig, windows, 1, 16);
+    ASSERT(stats.windows_with_sdc > 0);
+    ASSERT(stats.unconfirmed == 0);
+    bool checked = false;
+    for (const auto& w : windows) {
+        if (w.target_node != 5 || w.inputs != std::vector<int>{3, 4}) continue;
+        ASSERT(w.care.size() == 1);
+        ASSERT(!w.care.empty() && w.care[0] == 0x7777777777777777ull);
+        checked = true;
+    }
+    ASSERT(checked);
+    
+    // Windows over the independent PIs keep every pattern
+    for (const auto& w : windows) {
+        if (w.inputs == std::vector<int>{1, 2}) ASSERT(w.care.empty());
+    }
+    std::cout << "✓ Impossible leaf combinations become don't-cares\n";
+}
+
+void test_truth_table_interning() {
+    std::cout << "\n=== TESTING TRUTH TABLE INTERNING ===\n";
+    
+    TruthTableStore& store = TruthTableStore::global();
+    TruthTableStore::Stats before = store.stats();
+    uint64_t a[2] = {0x1234, 0x5678}, b[2] = {0x1234, 0x5679};
+    {
+        TruthTables x = { {a[0], a[1]}, {b[0], b[1]} };
+        TruthTables y;
+        y.push_back(a, 2);
+        y.push_back(a, 2);
+        // Equal contents share one row, different contents do not
+        ASSERT(x[0] == y[0] && y[0] == y[1]);
+        ASSERT(x[0] != x[1]);
+        ASSERT(x[0].size() == 2 && x[1][1] == 0x5679);
+        ASSERT(x[0] < x[1] && !(x[1] < x[0]));
+        TruthTableStore::Stats during = store.stats();
+        ASSERT(during.rows == before.rows + 2);
+        ASSERT(during.words == before.words + 4);
+        ASSERT(during.shared == before.shared + 2);
+        
+        // Copies take references; rows outlive the original
+        TruthTables z = x;
+        x.clear();
+        ASSERT(z[1][0] == 0x1234 && z == TruthTables({ {a[0], a[1]}, {b[0], b[1]} }));
+        ASSERT(store.stats().rows == before.rows + 2);
+    }
+    // Released rows leave the index and their slots are reused
+    ASSERT(store.stats().rows == before.rows);
+    ASSERT(store.stats().words == before.words);
+    
+    // Overlapping windows share rows: every projection of a leaf is stored once
+    aigman aig(4, 1);
+    int g1 = aig.newgate(2, 4);
+    int g2 = aig.newgate(6, 8);
+    int g3 = aig.newgate(2 * g1, 2 * g2);
+    aig.vPos[0] = 2 * g3;
+    std::vector<Window> windows;
+    window_extract_all(aig, 4, false, windows);
+    size_t references = 0;
+    std::vector<const uint64_t*> rows;
+    for (auto& w : windows) {
+        w.truth_tables = compute_truth_tables_for_window(aig, w, false);
+        for (const auto& tt : w.truth_tables) {
+            references++;
+            rows.push_back(tt.data());
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    ASSERT(rows.size() < references);
+    std::cout << "✓ " << references << " truth tables stored as " << rows.size() << " rows\n";
+}
+
+void test_huge_page_arena() {
+    std::cout << "\n=== TESTING HUGE-PAGE ARENA ===\n";
+    
+    HugePageArena arena(HugePageArena::HUGE_PAGE);
+    char* a = static_cast<char*>(arena.allocate(100));
+    char* b = static_cast<char*>(arena.allocate(100, 256));
+    ASSERT(a && b);
+    ASSERT(reinterpret_cast<uintptr_t>(b) % 256 == 0 && b >= a + 100);
+    // Larger than a block: gets a block of its own
+    char* big = static_cast<char*>(arena.allocate(3 * HugePageArena::HUGE_PAGE));
+    ASSERT(big != nullptr);
+    if (a && big) {
+        a[0] = 1;
+        big[3 * HugePageArena::HUGE_PAGE - 1] = 2;
+    }
+    HugePageArena::Stats stats = arena.stats();
+    ASSERT(stats.bytes == 200 + 3 * HugePageArena::HUGE_PAGE);
+    ASSERT(stats.huge_pages + stats.thp_pages == 4);
+    arena.reset();
+    ASSERT(arena.stats().bytes == 0 && arena.stats().peak_bytes == stats.bytes);
+    
+    // The truth-table store keeps its memory while rows are live
+    TruthTableStore store;
+    uint64_t words[4] = {1, 2, 3, 4};
+    const uint64_t* row = store.intern(words, 4);
+    ASSERT(store.arena_stats().bytes > 0);
+    ASSERT(!store.release_memory());
+    store.release(row);
+    ASSERT(store.release_memory());
+    ASSERT(store.arena_stats().bytes == 0);
+    row = store.intern(words, 4);
+    ASSERT(TruthTableStore::row_size(row) == 4 && row[3] == 4);
+    std::cout << "✓ Arena allocates, resets and reports page counts\n";
+}
+
+void test_numa_pool() {
+    std::cout << "\n=== TESTING NUMA WORKER POOL ===\n";
+    
+    // Two nodes without CPU lists: workers are not pinned but get a node
+    NumaTopology topology;
+    topology.node_cpus.resize(2);
+    const int n = 1000;
+    std::vector<std::atomic<int>> runs(n);
+    std::vector<int> ran_on(n, -1);
+    NumaStats stats;
+    numa_parallel_for(0, n, 4, topology, [](int i) { return i % 3 == 0 ? -1 : i % 2; }, [&](int i) {
+        runs[i]++;
+        ran_on[i] = numa_current_node();
+    }, &stats);
+    bool once = true;
+    size_t foreign = 0;
+    for (int i = 0; i < n; i++) {
+        once = once && runs[i] == 1;
+        int home = i % 3 == 0 ? i * 2 / n : i % 2;
+        foreign += ran_on[i] != home;
+    }
+    ASSERT(once);
+    ASSERT(stats.items == n && stats.steals == foreign);
+    
+    // Rows interned on a node come from that node's arena; equal contents
+    // still share one row whichever node asks
+    TruthTableStore store;
+    uint64_t words[2] = {5, 6};
+    const uint64_t* row0 = store.intern(words, 2);
+    const uint64_t* row1 = nullptr;
+    const uint64_t* other = nullptr;
+    std::thread worker([&]() {
+        numa_bind_thread(topology, 1);
+        uint64_t w[2] = {7, 8};
+        row1 = store.intern(words, 2);
+        other = store.intern(w, 2);
+    });
+    worker.join();
+    ASSERT(row1 == row0 && TruthTableStore::row_node(row0) == numa_current_node());
+    ASSERT(other && TruthTableStore::row_node(other) == 1 && TruthTableStore::row_size(other) == 2 && other[1] == 8);
+    std::cout << "✓ Pool runs every item once, counts steals and places rows per node\n";
 }
 
 int main() {
@@ -114,6 +347,11 @@ int main() {
     std::cout << "========================================\n\n";
     
     test_truth_table_computation();
+    test_window_care();
+    test_window_sdc();
+    test_truth_table_interning();
+    test_huge_page_arena();
+    test_numa_pool();
     
     std::cout << "========================================\n";
     std::cout << "         TEST RESULTS SUMMARY          \n";
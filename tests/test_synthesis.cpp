@@ -463,6 +463,32 @@ void test_conversion_function() {
         std::cout << "    ✓ Multi-word conversion successful (" << br.size() << " patterns)\n";
     }
     
+    // Test 4: Care mask leaves observability don't-cares unconstrained
+    {
+        std::cout << "\n  Testing conversion with a care mask\n";
+        
+        std::vector<std::vector<uint64_t>> truth_tables = {
+            {0x5}, // Divisor 0: 0101
+            {0x8}  // Target: 1000 = AND of the two inputs
+        };
+        std::vector<int> selected_divisors = {0};
+        uint64_t care = 0xC; // only patterns where input 1 is set are observable
+        
+        std::vector<std::vector<bool>> br;
+        generate_relation(truth_tables, selected_divisors, 2, br, &care);
+        
+        // Target is the complement of divisor 0 on the care patterns
+        ASSERT(br.size() == 2);
+        ASSERT(!br[0][0] && br[0][1]);
+        ASSERT(br[1][0] && !br[1][1]);
+        
+        // Exact: divisor 0 = 0 must produce both target values (infeasible)
+        generate_relation(truth_tables, selected_divisors, 2, br);
+        ASSERT(!br[0][0] && !br[0][1]);
+        
+        std::cout << "    ✓ Care-mask conversion successful\n";
+    }
+    
     std::cout << "\n  ✓ Conversion testing completed\n\n";
 }
 
@@ -1,11 +1,13 @@
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <memory>
 
 #include <aig.hpp>
 
 #include "window.hpp"
 #include "aig_utils.hpp"
+#include "cut_enum.hpp"
 
 int total_tests = 0;
 int passed_tests = 0;
@@ -247,10 +249,282 @@ void test_hardcoded_aig() {
             ASSERT(std::find(window.nodes.begin(), window.nodes.end(), divisor) != window.nodes.end());
         }
         
+        // Verify the window-local snapshot agrees with the global computations
+        const auto& local = window.local;
+        ASSERT(local.flags.size() == window.nodes.size());
+        ASSERT(window.nodes[local.target] == window.target_node);
+        ASSERT(window.mffc_size == static_cast<int>(mffc.size()));
+        for (size_t i = 0; i < window.nodes.size(); i++) {
+            int node = window.nodes[i];
+            ASSERT(((local.flags[i] & WindowSnapshot::MFFC) != 0) == (mffc.count(node) != 0));
+            ASSERT(((local.flags[i] & WindowSnapshot::TFO) != 0) == (tfo.count(node) != 0));
+        }
+        for (int node : local.mffc_below) {
+            ASSERT(mffc.count(node) != 0);
+            ASSERT(std::find(window.nodes.begin(), window.nodes.end(), node) == window.nodes.end());
+        }
+        ASSERT(local.divisors.size() == window.divisors.size());
+        for (size_t i = 0; i < local.divisors.size(); i++) {
+            ASSERT(window.nodes[local.divisors[i]] == window.divisors[i]);
+        }
+        
         std::cout << "  ✓ Divisors correctly exclude MFFC(" << window.target_node << ") and TFO(" << window.target_node << ")\n\n";
     }
 }
 
+void test_window_order() {
+    std::cout << "=== TESTING WINDOW ORDERING ===\n";
+    
+    // Same AIG as test_hardcoded_aig
+    aigman aig(3, 1);
+    aig.vObjs.resize(9 * 2);
+    aig.vObjs[4 * 2] = 2;  aig.vObjs[4 * 2 + 1] = 4;
+    aig.vObjs[5 * 2] = 4;  aig.vObjs[5 * 2 + 1] = 6;
+    aig.vObjs[6 * 2] = 8;  aig.vObjs[6 * 2 + 1] = 10;
+    aig.vObjs[7 * 2] = 8;  aig.vObjs[7 * 2 + 1] = 6;
+    aig.vObjs[8 * 2] = 12; aig.vObjs[8 * 2 + 1] = 14;
+    aig.nGates = 5;
+    aig.nObjs = 9;
+    aig.vPos[0] = 16;
+    
+    std::vector<Window> reference;
+    window_extract_all(aig, 4, false, reference);
+    std::vector<int> levels = compute_levels(aig);
+    ASSERT(levels[4] == 1 && levels[6] == 2 && levels[8] == 3);
+    
+    for (WindowOrder order : {WindowOrder::LEVEL, WindowOrder::LOCALITY, WindowOrder::CUT_ID}) {
+        std::vector<Window> windows;
+        window_enumerate_all(aig, 4, false, windows);
+        window_order(aig, windows, order);
+        window_analyze_all(aig, windows);
+        
+        // Ordering is a permutation that keeps each window's cut ID and analysis
+        ASSERT(windows.size() == reference.size());
+        std::vector<bool> seen(windows.size(), false);
+        for (size_t i = 0; i < windows.size(); i++) {
+            const auto& w = windows[i];
+            const auto& ref = reference[w.cut_id];
+            ASSERT(!seen[w.cut_id]);
+            seen[w.cut_id] = true;
+            ASSERT(w.target_node == ref.target_node);
+            ASSERT(w.divisors == ref.divisors);
+            ASSERT(w.mffc_size == ref.mffc_size);
+            if (i > 0 && order == WindowOrder::LEVEL) {
+                ASSERT(levels[windows[i - 1].target_node] <= levels[w.target_node]);
+            }
+            if (order == WindowOrder::CUT_ID) {
+                ASSERT(w.cut_id == static_cast<int>(i));
+            }
+        }
+    }
+    std::cout << "✓ Window ordering preserves windows\n\n";
+}
+
+// True if every path from target towards the PIs hits a leaf
+static bool is_cut(const aigman& aig, int target, const InlineCut& cut) {
+    std::vector<int> stack = {target};
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        if (std::find(cut.begin(), cut.end(), node) != cut.end()) continue;
+        if (node <= aig.nPis) return node == 0;
+        stack.push_back(lit2var(aig.vObjs[node * 2]));
+        stack.push_back(lit2var(aig.vObjs[node * 2 + 1]));
+    }
+    return true;
+}
+
+void test_native_cut_enumeration() {
+    std::cout << "=== TESTING NATIVE CUT ENUMERATION ===\n";
+    
+    // Wide random AIG so that levels are split across threads
+    aigman aig(16, 1);
+    uint32_t state = 12345;
+    auto next = [&state]() { state = state * 1103515245u + 12345u; return state >> 8; };
+    for (int i = 0; i < 1500; i++) {
+        int a = 1 + next() % (aig.nObjs - 1);
+        int b = 1 + next() % (aig.nObjs - 1);
+        if (a == b) b = (b % (aig.nObjs - 1)) + 1;
+        if (a == b) continue;
+        aig.newgate(2 * a + (next() & 1), 2 * b + (next() & 1));
+    }
+    aig.vPos[0] = 2 * (aig.nObjs - 1);
+    
+    CutSet serial, parallel;
+    enumerate_cuts(aig, 4, 0, 1, serial);
+    enumerate_cuts(aig, 4, 0, 4, parallel);
+    ASSERT(serial.cuts.size() == parallel.cuts.size());
+    ASSERT(serial.first == parallel.first && serial.count == parallel.count);
+    bool same = serial.cuts.size() == parallel.cuts.size();
+    for (size_t i = 0; same && i < serial.cuts.size(); i++) {
+        same = std::equal(serial.cuts[i].begin(), serial.cuts[i].end(),
+                          parallel.cuts[i].begin(), parallel.cuts[i].end());
+    }
+    ASSERT(same);
+    
+    // Every cut is a sorted, valid cut of its node, and none dominates another
+    bool valid = true, dominance_free = true, signatures = true;
+    for (int node = aig.nPis + 1; node < aig.nObjs; node++) {
+        const InlineCut* b = serial.node_begin(node);
+        const InlineCut* e = serial.node_end(node);
+        valid &= b->size == 1 && b->leaves[0] == node;
+        for (const InlineCut* c = b + 1; c != e; ++c) {
+            valid &= c->size <= 4 && std::is_sorted(c->begin(), c->end()) && is_cut(aig, node, *c);
+            uint64_t sig = 0;
+            for (int leaf : *c) sig |= 1ull << (leaf % 64);
+            signatures &= sig == c->signature;
+            for (const InlineCut* d = b + 1; d != e; ++d) {
+                if (c != d && std::includes(d->begin(), d->end(), c->begin(), c->end())) dominance_free = false;
+            }
+        }
+    }
+    ASSERT(valid);
+    ASSERT(signatures);
+    ASSERT(dominance_free);
+    
+    // The cap keeps the smallest cuts
+    CutSet capped;
+    enumerate_cuts(aig, 4, 2, 4, capped);
+    bool within_cap = true;
+    for (int node = aig.nPis + 1; node < aig.nObjs; node++) {
+        within_cap &= capped.count[node] <= 3;
+        for (const InlineCut* c = capped.node_begin(node) + 1; c + 1 < capped.node_end(node); ++c) {
+            within_cap &= c->size <= (c + 1)->size;
+        }
+    }
+    ASSERT(within_cap);
+    
+    // Dead nodes get no cuts and do not disturb the others
+    aigman with_dead = aig;
+    with_dead.newgate(2, 4);
+    with_dead.vDeads.assign(with_dead.nObjs, 0);
+    with_dead.vDeads[with_dead.nObjs - 1] = 1;
+    CutSet dead_cuts;
+    enumerate_cuts(with_dead, 4, 0, 4, dead_cuts);
+    ASSERT(dead_cuts.count[with_dead.nObjs - 1] == 0);
+    ASSERT(dead_cuts.cuts.size() == serial.cuts.size());
+    AigSnapshot dead_snapshot;
+    build_aig_snapshot(with_dead, 1, dead_snapshot);
+    std::vector<Window> dead_windows;
+    window_enumerate_all_native(dead_snapshot, 4, 0, 1, false, dead_windows);
+    size_t live_windows = 0;
+    for (int node = aig.nPis + 1; node < aig.nObjs; node++) live_windows += serial.count[node] - 1;
+    ASSERT(dead_windows.size() == live_windows);
+    
+    // Windows from native cuts: one per non-trivial cut, containing target and leaves
+    std::vector<Window> windows;
+    window_enumerate_all_native(aig, 4, 0, 4, false, windows);
+    size_t expected = 0;
+    for (int node = aig.nPis + 1; node < aig.nObjs; node++) expected += serial.count[node] - 1;
+    ASSERT(windows.size() == expected);
+    bool contained = true;
+    for (size_t i = 0; i < windows.size(); i++) {
+        const Window& w = windows[i];
+        contained &= w.cut_id == static_cast<int>(i);
+        contained &= std::binary_search(w.nodes.begin(), w.nodes.end(), w.target_node);
+        for (int leaf : w.inputs) contained &= std::binary_search(w.nodes.begin(), w.nodes.end(), leaf);
+    }
+    ASSERT(contained);
+    std::cout << "✓ Native cuts are valid, dominance-free and thread-count independent\n\n";
+}
+
+void test_aig_snapshot() {
+    std::cout << "=== TESTING AIG SNAPSHOT ===\n";
+    
+    aigman aig(12, 2);
+    uint32_t state = 777;
+    auto next = [&state]() { state = state * 1103515245u + 12345u; return state >> 8; };
+    for (int i = 0; i < 600; i++) {
+        int a = 1 + next() % (aig.nObjs - 1);
+        int b = 1 + next() % (aig.nObjs - 1);
+        if (a == b) continue;
+        aig.newgate(2 * a + (next() & 1), 2 * b + (next() & 1));
+    }
+    aig.vPos[0] = 2 * (aig.nObjs - 1);
+    aig.vPos[1] = 2 * (aig.nObjs - 2) + 1;
+    
+    AigSnapshot serial, parallel;
+    build_aig_snapshot(aig, 1, serial);
+    build_aig_snapshot(aig, 4, parallel);
+    ASSERT(serial.fanins == parallel.fanins && serial.refs == parallel.refs && serial.levels == parallel.levels);
+    ASSERT(serial.fanout_offsets == parallel.fanout_offsets && serial.fanout_indices == parallel.fanout_indices);
+    
+    // Fanouts and references agree with supportfanouts, levels with compute_levels
+    aigman copy = aig;
+    copy.supportfanouts();
+    std::vector<int> levels = compute_levels(copy);
+    bool fanouts_match = true, refs_match = true, levels_match = true;
+    for (int node = 0; node < aig.nObjs; node++) {
+        std::vector<int> gates;
+        for (int fo : copy.vvFanouts[node]) {
+            if (fo < aig.nObjs) gates.push_back(fo);
+        }
+        std::sort(gates.begin(), gates.end());
+        fanouts_match &= std::equal(gates.begin(), gates.end(), serial.fanouts_begin(node), serial.fanouts_end(node));
+        refs_match &= serial.refs[node] == static_cast<int>(copy.vvFanouts[node].size());
+        levels_match &= serial.levels[node] == levels[node];
+    }
+    ASSERT(fanouts_match);
+    ASSERT(refs_match);
+    ASSERT(levels_match);
+    
+    // Parallel analysis gives the same windows as the serial aigman path
+    std::vector<Window> reference, windows;
+    window_extract_all(aig, 4, false, reference);
+    window_enumerate_all(aig, parallel, 4, false, windows);
+    window_analyze_all(parallel, windows, 4);
+    ASSERT(windows.size() == reference.size());
+    bool same = windows.size() == reference.size();
+    for (size_t i = 0; same && i < windows.size(); i++) {
+        same = windows[i].nodes == reference[i].nodes && windows[i].divisors == reference[i].divisors &&
+               windows[i].mffc_size == reference[i].mffc_size && windows[i].local.flags == reference[i].local.flags;
+    }
+    ASSERT(same);
+    std::cout << "✓ Snapshot matches the aigman and is thread-count independent\n\n";
+}
+
+void test_window_stream() {
+    std::cout << "=== TESTING STREAMED WINDOW ENUMERATION ===\n";
+    
+    aigman aig(12, 1);
+    uint32_t state = 777;
+    auto next = [&state]() { state = state * 1103515245u + 12345u; return state >> 8; };
+    for (int i = 0; i < 400; i++) {
+        int a = 1 + next() % (aig.nObjs - 1);
+        int b = 1 + next() % (aig.nObjs - 1);
+        if (a == b) continue;
+        aig.newgate(2 * a + (next() & 1), 2 * b + (next() & 1));
+    }
+    aig.vPos[0] = 2 * (aig.nObjs - 1);
+    AigSnapshot snapshot;
+    build_aig_snapshot(aig, 1, snapshot);
+    
+    // Small runs concatenate to the windows of a single enumeration; nodes
+    // above a run's targets still belong to its windows
+    for (int native = 0; native < 2; native++) {
+        std::vector<Window> all, run, streamed;
+        if (native) {
+            window_enumerate_all_native(snapshot, 4, 0, 1, false, all);
+        } else {
+            window_enumerate_all(aig, snapshot, 4, false, all);
+        }
+        std::unique_ptr<WindowStream> stream(native ? new WindowStream(snapshot, 4, 0, 1, false)
+                                                    : new WindowStream(aig, snapshot, 4, false));
+        int runs = 0;
+        while (stream->next(run, 37)) {
+            runs++;
+            for (auto& w : run) streamed.push_back(std::move(w));
+        }
+        ASSERT(runs > 1);
+        bool same = streamed.size() == all.size();
+        for (size_t i = 0; same && i < all.size(); i++) {
+            same = streamed[i].cut_id == all[i].cut_id && streamed[i].target_node == all[i].target_node &&
+                   streamed[i].inputs == all[i].inputs && streamed[i].nodes == all[i].nodes;
+        }
+        ASSERT(same);
+    }
+    std::cout << "✓ Streamed runs match a single enumeration\n\n";
+}
 
 int main() {
     std::cout << "========================================\n";
@@ -259,6 +533,10 @@ int main() {
     
     // Test hardcoded AIG for verification
     test_hardcoded_aig();
+    test_window_order();
+    test_native_cut_enumeration();
+    test_aig_snapshot();
+    test_window_stream();
     
     std::cout << "========================================\n";
     std::cout << "         TEST RESULTS SUMMARY          \n";